@@ -39,8 +39,13 @@ public:
     // stop program
     std::atomic<bool> stop = false;
 
+    // stop the current solve and keep the best solution found so far
+    std::atomic<bool> cancel = false;
+
     // solving the cube (back to front)
     std::stack<Rotations> solve;
+    // no shorter solution than solve exists
+    bool solve_optimal = false;
 
 private:
     // queue of next actions that the window manager
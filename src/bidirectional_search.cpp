@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+#include <parallel_hashmap/phmap.h>
+
+
+#include "actions.h"
+#include "bidirectional_search.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "rotation.h"
+#include "search.h"
+#include "settings.h"
+#include "visited.h"
+
+
+constexpr int kMaxBidirectionalDepth = 100;
+// priority is max(depth + heuristic, 2 * depth)
+constexpr int kNumPriorities = 2 * kMaxBidirectionalDepth + 2;
+constexpr int kNotFoundSol = 1e9;
+
+
+#pragma pack(push, 1)
+struct BidirectionalNode {
+    Cube::Hash hash;
+    uint8_t depth;
+};
+#pragma pack(pop)
+
+
+// one direction of the search
+struct Frontier {
+    // depth and rotation leading to the position from this side
+    phmap::flat_hash_map<CubeMapVisited, std::pair<uint8_t, Rotations>,
+            phmap::priv::hash_default_hash<CubeMapVisited>, phmap::priv::hash_default_eq<CubeMapVisited>> visited;
+
+    std::array<std::vector<BidirectionalNode>, kNumPriorities> open;
+    int min_priority = kNumPriorities;
+    size_t open_size = 0;
+
+    // pattern database values of the position this side is searching for
+    std::array<int, 3> target;
+
+    int Priority () {
+        while (min_priority < kNumPriorities && open[min_priority].empty()) {
+            min_priority++;
+        }
+        return min_priority;
+    }
+
+    // lower bound of the distance to the target
+    // |h(cube) - h(target)| of every pattern database is a lower bound of the distance between them
+    int Heuristic (Cube& cube) const {
+        return std::max({std::abs(cube.GetCornerHeuristic() - target[0]),
+                         std::abs(int(cube.GetEdgeHeuristic1()) - target[1]),
+                         std::abs(int(cube.GetEdgeHeuristic2()) - target[2])});
+    }
+
+    void Push (Cube& cube, int depth) {
+        int priority = std::min(std::max(depth + Heuristic(cube), 2 * depth), kNumPriorities-1);
+        open[priority].push_back({cube.GetHash(), uint8_t(depth)});
+        open_size++;
+        min_priority = std::min(min_priority, priority);
+    }
+};
+
+
+std::array<int, 3> PatternDatabaseValues (Cube& cube) {
+    return {cube.GetCornerHeuristic(), int(cube.GetEdgeHeuristic1()), int(cube.GetEdgeHeuristic2())};
+}
+
+
+// expand the best position of one side and check whether it meets the other side
+// depth_capped is set once a position is dropped at kMaxBidirectionalDepth
+void ExpandFrontier (Frontier& frontier, Frontier& opposite, int& best_depth, Cube::Hash& meeting_hash, bool& depth_capped) {
+    int priority = frontier.Priority();
+    BidirectionalNode node = frontier.open[priority].back();
+    frontier.open[priority].pop_back();
+    frontier.open_size--;
+
+    // a shorter path to this position has been found
+    if (frontier.visited.find({node.hash})->second.first < node.depth) {
+        return;
+    }
+    if (node.depth >= kMaxBidirectionalDepth) {
+        depth_capped = true;
+        return;
+    }
+
+    Cube cube = DecodeHash(node.hash);
+    for (Rotations rotation : GetLegalRotations(cube)) {
+        Cube next_cube = Rotate(cube, rotation);
+        CubeMapVisited next = {next_cube.GetHash()};
+        int next_depth = node.depth + 1;
+
+        // meeting the other side
+        auto opposite_it = opposite.visited.find(next);
+        if (opposite_it != opposite.visited.end() && next_depth + opposite_it->second.first < best_depth) {
+            best_depth = next_depth + opposite_it->second.first;
+            meeting_hash = next.hash;
+        }
+
+        auto [it, inserted] = frontier.visited.try_emplace(next, uint8_t(next_depth), rotation);
+        if (!inserted) {
+            if (it->second.first <= next_depth) {
+                continue;
+            }
+            it->second = {uint8_t(next_depth), rotation};
+        }
+        frontier.Push(next_cube, next_depth);
+    }
+}
+
+
+// MM: both sides expand the position with the lowest max(f, 2g)
+// the best meeting is optimal as soon as it is not larger than the smallest priority of both sides
+bool BidirectionalSolve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions, SolveStop& solve_stop) {
+    Cube solved_cube;
+
+    // forward from the start and backward from the solved position
+    Frontier forward;
+    Frontier backward;
+    forward.target = PatternDatabaseValues(solved_cube);
+    backward.target = PatternDatabaseValues(start_cube);
+
+    forward.visited[{start_cube.GetHash()}] = {0, Rotations(-1)};
+    forward.Push(start_cube, 0);
+    backward.visited[{solved_cube.GetHash()}] = {0, Rotations(-1)};
+    backward.Push(solved_cube, 0);
+
+    int best_depth = kNotFoundSol;
+    Cube::Hash meeting_hash;
+    bool optimal = false;
+    bool depth_capped = false;
+
+    while (num_positions < settings.max_num_positions) {
+        int forward_priority = forward.Priority();
+        int backward_priority = backward.Priority();
+        if (best_depth <= std::min(forward_priority, backward_priority)) {
+            optimal = true;
+            break;
+        }
+        // one side is exhausted, this only proves the best meeting optimal if no position was cut off
+        if (forward_priority == kNumPriorities || backward_priority == kNumPriorities) {
+            optimal = best_depth != kNotFoundSol && !depth_capped;
+            break;
+        }
+
+        // cancelled or out of time
+        if (++num_positions % kStopCheckInterval == 0 && solve_stop.StopRequested()) {
+            break;
+        }
+        // on equal priority the smaller side grows
+        if (forward_priority < backward_priority || (forward_priority == backward_priority && forward.open_size <= backward.open_size)) {
+            ExpandFrontier(forward, backward, best_depth, meeting_hash, depth_capped);
+        }
+        else {
+            ExpandFrontier(backward, forward, best_depth, meeting_hash, depth_capped);
+        }
+    }
+
+    if (solve_stop.DeadlineReached()) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "bidirectional_search.cpp", "time limit reached after " + std::to_string(num_positions) + " positions");
+    }
+    error_handler.Handle(ErrorHandler::Level::kMemory, "bidirectional_search.cpp", "forward positions: " + std::to_string(forward.visited.size()) + " backward positions: " + std::to_string(backward.visited.size()));
+    if (optimal) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "bidirectional_search.cpp", "found optimal solution");
+    }
+    actions.solve_optimal = optimal;
+    if (best_depth == kNotFoundSol) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "bidirectional_search.cpp", "Did not find a solution within " + std::to_string(num_positions) + " positions");
+        return false;
+    }
+
+    // rotations from the meeting position to the solved position (pushed last to first)
+    std::vector<Rotations> backward_path;
+    Cube cube = DecodeHash(meeting_hash);
+    for (Rotations rotation = backward.visited[{cube.GetHash()}].second; rotation != Rotations(-1); rotation = backward.visited[{cube.GetHash()}].second) {
+        backward_path.push_back(CounterRotation(rotation));
+        cube = Rotate(cube, CounterRotation(rotation));
+    }
+    for (auto rotation = backward_path.rbegin(); rotation != backward_path.rend(); rotation++) {
+        actions.solve.push(*rotation);
+    }
+
+    // rotations from the start to the meeting position
+    cube = DecodeHash(meeting_hash);
+    for (Rotations rotation = forward.visited[{cube.GetHash()}].second; rotation != Rotations(-1); rotation = forward.visited[{cube.GetHash()}].second) {
+        actions.solve.push(rotation);
+        cube = Rotate(cube, CounterRotation(rotation));
+    }
+    return true;
+}
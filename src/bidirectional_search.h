@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "search.h"
+#include "settings.h"
+
+
+// bidirectional search meeting in the middle between the start and the solved position
+bool BidirectionalSolve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions, SolveStop& solve_stop);
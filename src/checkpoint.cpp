@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+#include "checkpoint.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "open_list.h"
+#include "rotation.h"
+#include "tablebase.h"
+#include "visited.h"
+
+
+constexpr uint32_t kMagic = 0x4b434350; // "PCCK"
+constexpr uint32_t kVersion = 1;
+// records per block
+constexpr size_t kBlockSize = size_t(1) << 16;
+
+
+#pragma pack(push, 1)
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    // the queue entries depend on PACKED_QUEUE
+    uint32_t queue_entry_bytes;
+    uint32_t tablebase_depth;
+    Cube::Hash start_hash;
+    uint8_t stores_rotations;
+};
+
+struct VisitedRecord {
+    Cube::Hash hash;
+    uint8_t depth;
+    Rotations rotation;
+};
+
+struct QueueRecord {
+    CubeSearch cube_search;
+    uint8_t bound_key;
+};
+#pragma pack(pop)
+
+
+template <class Value>
+bool WriteValue (std::FILE* file, const Value& value) {
+    return std::fwrite(&value, sizeof(Value), 1, file) == 1;
+}
+
+
+template <class Value>
+bool ReadValue (std::FILE* file, Value& value) {
+    return std::fread(&value, sizeof(Value), 1, file) == 1;
+}
+
+
+// a block is its number of records followed by the records, an empty block ends the section
+template <class Record>
+bool WriteBlock (std::FILE* file, std::vector<Record>& block) {
+    uint32_t size = block.size();
+    bool written = WriteValue(file, size) && (size == 0 || std::fwrite(block.data(), sizeof(Record), size, file) == size);
+    block.clear();
+    return written;
+}
+
+
+template <class Record>
+bool ReadBlocks (std::FILE* file, const std::function<void (const Record&)>& visit) {
+    std::vector<Record> block;
+    while (true) {
+        uint32_t size;
+        if (!ReadValue(file, size)) {
+            return false;
+        }
+        if (size == 0) {
+            return true;
+        }
+        block.resize(size);
+        if (std::fread(block.data(), sizeof(Record), size, file) != size) {
+            return false;
+        }
+        for (const Record& record : block) {
+            visit(record);
+        }
+    }
+}
+
+
+bool SameHash (Cube::Hash hash_1, Cube::Hash hash_2) {
+    return hash_1.hash_1 == hash_2.hash_1 && hash_1.hash_2 == hash_2.hash_2;
+}
+
+
+bool WriteProgress (std::FILE* file, const SearchProgress& progress) {
+    uint32_t path_size = progress.incumbent.path.size();
+    return WriteValue(file, progress.num_positions) && WriteValue(file, int32_t(progress.max_depth)) &&
+           WriteValue(file, progress.incumbent.tablebase_cube) && WriteValue(file, uint8_t(progress.incumbent.path_known)) &&
+           WriteValue(file, path_size) &&
+           std::fwrite(progress.incumbent.path.data(), sizeof(Rotations), path_size, file) == path_size;
+}
+
+
+bool ReadProgress (std::FILE* file, SearchProgress& progress) {
+    int32_t max_depth;
+    uint8_t path_known;
+    uint32_t path_size;
+    if (!ReadValue(file, progress.num_positions) || !ReadValue(file, max_depth) ||
+        !ReadValue(file, progress.incumbent.tablebase_cube) || !ReadValue(file, path_known) || !ReadValue(file, path_size)) {
+        return false;
+    }
+    progress.max_depth = max_depth;
+    progress.incumbent.path_known = path_known != 0;
+    progress.incumbent.path.resize(path_size);
+    return std::fread(progress.incumbent.path.data(), sizeof(Rotations), path_size, file) == path_size;
+}
+
+
+// the data has to be on the disk before the file replaces the last checkpoint
+bool SyncFile (std::FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+    #ifndef _WIN32
+    return fsync(fileno(file)) == 0;
+    #else
+    return true;
+    #endif
+}
+
+
+bool WriteCheckpoint (ErrorHandler error_handler, const std::string& file_name, Cube::Hash start_hash,
+                      const Visited& visited, OpenList& open_list, const std::function<SearchProgress ()>& get_progress) {
+    auto start_time = std::chrono::steady_clock::now();
+    std::string temp_file_name = file_name + ".tmp";
+    std::FILE* file = std::fopen(temp_file_name.c_str(), "wb");
+    if (file == nullptr) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "checkpoint.cpp", "could not open " + temp_file_name);
+        return false;
+    }
+
+    Header header = {kMagic, kVersion, sizeof(CubeSearch), uint32_t(GetTablebaseDepth()), start_hash, uint8_t(visited.StoresRotations())};
+    bool written = WriteValue(file, header);
+
+    // the workers keep going, so this is only a fuzzy copy of the visited positions
+    std::vector<VisitedRecord> visited_block;
+    for (size_t chunk = 0; chunk < visited.NumChunks() && written; chunk++) {
+        visited.ForEachInChunk(chunk, [&visited_block](Cube::Hash hash, uint8_t depth, Rotations rotation) {
+            visited_block.push_back({hash, depth, rotation});
+        });
+        if (visited_block.size() >= kBlockSize) {
+            written = WriteBlock(file, visited_block);
+        }
+    }
+    written = written && (visited_block.empty() || WriteBlock(file, visited_block)) && WriteBlock(file, visited_block);
+
+    // every queued position now has its parent in the visited positions written above
+    // or its parent got expanded later, then it is in the open list as well
+    // only the queues in memory are copied during the pause, the run files are read afterwards
+    auto pause_time = std::chrono::steady_clock::now();
+    open_list.Pause();
+    SearchProgress progress = get_progress();
+    std::vector<OpenList::QueueSnapshot> snapshot = open_list.Snapshot();
+    open_list.Resume();
+    auto resume_time = std::chrono::steady_clock::now();
+
+    written = written && WriteProgress(file, progress);
+    bool complete = true;
+    std::vector<QueueRecord> queue_block;
+    auto write_positions = [file, &written, &queue_block](const std::vector<CubeSearch>& positions, int bound_key) {
+        for (const CubeSearch& cube_search : positions) {
+            queue_block.push_back({cube_search, uint8_t(bound_key)});
+            if (queue_block.size() >= kBlockSize && written) {
+                written = WriteBlock(file, queue_block);
+            }
+        }
+    };
+    for (OpenList::QueueSnapshot& queue : snapshot) {
+        if (!written || !complete) {
+            break;
+        }
+        write_positions(queue.positions, queue.bound_key);
+        queue.positions = std::vector<CubeSearch>();
+        complete = open_list.ForEachSpilled(queue, [&write_positions, &queue](const std::vector<CubeSearch>& block) {
+            write_positions(block, queue.bound_key);
+        });
+    }
+    open_list.EndSnapshot();
+    written = written && (queue_block.empty() || WriteBlock(file, queue_block)) && WriteBlock(file, queue_block);
+    written = written && WriteValue(file, kMagic) && SyncFile(file);
+    written = std::fclose(file) == 0 && written;
+    if (!written || !complete) {
+        std::remove(temp_file_name.c_str());
+        error_handler.Handle(ErrorHandler::Level::kWarning, "checkpoint.cpp", "could not write the checkpoint " + file_name);
+        return false;
+    }
+    // replaces the last checkpoint at once
+    #ifdef _WIN32
+    std::remove(file_name.c_str());
+    #endif
+    if (std::rename(temp_file_name.c_str(), file_name.c_str()) != 0) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "checkpoint.cpp", "could not replace the checkpoint " + file_name);
+        return false;
+    }
+
+    std::chrono::duration<double> total_duration = std::chrono::steady_clock::now() - start_time;
+    std::chrono::duration<double, std::milli> pause_duration = resume_time - pause_time;
+    error_handler.Handle(ErrorHandler::Level::kExtra, "checkpoint.cpp", "wrote checkpoint " + file_name + " in " + std::to_string(total_duration.count()) +
+                         " s, workers paused for " + std::to_string(pause_duration.count()) + " ms");
+    return true;
+}
+
+
+ResumeResult ReadCheckpoint (ErrorHandler error_handler, const std::string& file_name, Cube::Hash start_hash,
+                             Visited& visited, OpenList& open_list, SearchProgress& progress) {
+    std::FILE* file = std::fopen(file_name.c_str(), "rb");
+    if (file == nullptr) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "checkpoint.cpp", "could not open the checkpoint " + file_name);
+        return ResumeResult::kNotFound;
+    }
+
+    Header header;
+    if (!ReadValue(file, header) || header.magic != kMagic || header.version != kVersion) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "checkpoint.cpp", file_name + " is not a checkpoint");
+        std::fclose(file);
+        return ResumeResult::kNotFound;
+    }
+    if (header.queue_entry_bytes != sizeof(CubeSearch) || header.tablebase_depth != uint32_t(GetTablebaseDepth())) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "checkpoint.cpp", "the checkpoint " + file_name + " needs the same --tablebase_depth and PACKED_QUEUE");
+        std::fclose(file);
+        return ResumeResult::kNotFound;
+    }
+    // a batch of runs shares the file, every run but one starts fresh
+    if (!SameHash(header.start_hash, start_hash)) {
+        error_handler.Handle(ErrorHandler::Level::kExtra, "checkpoint.cpp", "the checkpoint " + file_name + " belongs to another start position");
+        std::fclose(file);
+        return ResumeResult::kNotFound;
+    }
+
+    // without rotations the stored depths could not be used to walk back a path
+    bool use_visited = header.stores_rotations != 0 || !visited.StoresRotations();
+    if (!use_visited) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "checkpoint.cpp", "the checkpoint has no rotations, its visited positions are searched again");
+    }
+    bool read = ReadBlocks<VisitedRecord>(file, [&visited, use_visited](const VisitedRecord& record) {
+        if (use_visited) {
+            visited.Update(record.hash, record.depth, record.rotation);
+        }
+    });
+    read = read && ReadProgress(file, progress);
+    read = read && ReadBlocks<QueueRecord>(file, [&open_list](const QueueRecord& record) {
+        open_list.Push(record.cube_search, record.bound_key);
+    });
+    uint32_t end_magic;
+    read = read && ReadValue(file, end_magic) && end_magic == kMagic;
+    std::fclose(file);
+    if (!read) {
+        error_handler.Handle(ErrorHandler::Level::kError, "checkpoint.cpp", "the checkpoint " + file_name + " is damaged");
+        return ResumeResult::kDamaged;
+    }
+    error_handler.Handle(ErrorHandler::Level::kInfo, "checkpoint.cpp", "resumed from " + file_name + " after " + std::to_string(progress.num_positions) + " positions");
+    return ResumeResult::kResumed;
+}
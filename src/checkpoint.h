@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+#include "cube.h"
+#include "error_handler.h"
+#include "open_list.h"
+#include "rotation.h"
+#include "visited.h"
+
+
+// best solution found so far, guarded by the max_depth mutex
+struct Incumbent {
+    // position of the outermost tablebase layer the solution reaches
+    CubeSearch tablebase_cube;
+
+    // rotations from tablebase_cube back to the start position
+    std::vector<Rotations> path;
+    // entries of the path got replaced before it could be walked back
+    bool path_known = false;
+};
+
+
+// state of a search besides the visited positions and the open list
+struct SearchProgress {
+    uint64_t num_positions = 0;
+    int max_depth = 0;
+    Incumbent incumbent;
+};
+
+
+// a checkpoint is a stream of blocks of native binary records:
+// header, visited positions, progress, queued positions
+//
+// the visited positions are written while the workers keep searching
+// afterwards the workers are paused while get_progress is called and the open list is written
+// positions visited after their block was written are only searched again after a resume
+// the file is replaced once the new checkpoint is complete
+bool WriteCheckpoint (ErrorHandler error_handler, const std::string& file_name, Cube::Hash start_hash,
+                      const Visited& visited, OpenList& open_list, const std::function<SearchProgress ()>& get_progress);
+
+enum class ResumeResult {
+    kNotFound,  // no checkpoint of this search, nothing got loaded
+    kResumed,
+    kDamaged    // the file broke off while loading, the search is incomplete
+};
+
+// loads the checkpoint of a search from start_hash into empty visited positions and open list
+ResumeResult ReadCheckpoint (ErrorHandler error_handler, const std::string& file_name, Cube::Hash start_hash,
+                             Visited& visited, OpenList& open_list, SearchProgress& progress);
@@ -2,6 +2,7 @@
 #include <bit>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
 #include "cube.h"
@@ -9,13 +10,18 @@
 #include "settings.h"
 
 
-std::vector<uint16_t> position_data_table;
-std::vector<uint8_t> edge_data_table;
+// tables read from the files
+std::vector<uint16_t> position_data_storage;
+std::vector<uint8_t> edge_data_storage;
+// the loaded tables or the shared tables
+const uint16_t* position_data_table = nullptr;
+const uint8_t* edge_data_table = nullptr;
 
 
 // initialize position data
 void InitializePositionData (ErrorHandler& error_handler, Setting& settings) {
-    position_data_table = std::vector<uint16_t>(kNumPositions, 0);
+    position_data_storage = std::vector<uint16_t>(kNumPositions, 0);
+    position_data_table = position_data_storage.data();
 
     // get file location
     std::string corner_data_path = "position_data/corner-data.bin";
@@ -23,7 +29,7 @@ void InitializePositionData (ErrorHandler& error_handler, Setting& settings) {
 
     // read file
     if (std::FILE* file = std::fopen(corner_data_path.c_str(), "rb")) {
-        if (std::fread(position_data_table.data(), sizeof(position_data_table[0]), position_data_table.size(), file) != kNumPositions) {
+        if (std::fread(position_data_storage.data(), sizeof(position_data_storage[0]), position_data_storage.size(), file) != kNumPositions) {
             error_handler.Handle(ErrorHandler::kError, "cube.cpp", "not all positions found in corner-data.bin file");
         }
         std::fclose(file);
@@ -38,7 +44,8 @@ void InitializePositionData (ErrorHandler& error_handler, Setting& settings) {
 
 // initialize position data
 void InitializeEdgeData (ErrorHandler& error_handler, Setting& settings) {
-    edge_data_table = std::vector<uint8_t>(kNumEdgePositions, 0);
+    edge_data_storage = std::vector<uint8_t>(kNumEdgePositions, 0);
+    edge_data_table = edge_data_storage.data();
 
     // get file location
     std::string edge_data_path = "position_data/edge-data.bin";
@@ -46,7 +53,7 @@ void InitializeEdgeData (ErrorHandler& error_handler, Setting& settings) {
 
     // read file
     if (std::FILE* file = std::fopen(edge_data_path.c_str(), "rb")) {
-        if (std::fread(edge_data_table.data(), sizeof(edge_data_table[0]), edge_data_table.size(), file) != kNumEdgePositions) {
+        if (std::fread(edge_data_storage.data(), sizeof(edge_data_storage[0]), edge_data_storage.size(), file) != kNumEdgePositions) {
             error_handler.Handle(ErrorHandler::kError, "cube.cpp", "not all positions found in edge-data.bin file");
         }
         std::fclose(file);
@@ -59,6 +66,24 @@ void InitializeEdgeData (ErrorHandler& error_handler, Setting& settings) {
 }
 
 
+const uint16_t* PositionDataTable () {
+    return position_data_table;
+}
+
+
+const uint8_t* EdgeDataTable () {
+    return edge_data_table;
+}
+
+
+void UsePatternTables (const uint16_t* position_data, const uint8_t* edge_data) {
+    position_data_table = position_data;
+    edge_data_table = edge_data;
+    position_data_storage = std::vector<uint16_t>();
+    edge_data_storage = std::vector<uint8_t>();
+}
+
+
 uint16_t Cube::GetPositionData () {
     // get position hash and legal_move_data
     if (!got_position_data) {
@@ -319,6 +344,71 @@ Cube DecodeHash (Cube::Hash hash) {
     Cube new_cube;
     DecodeCornerHash(new_cube, (hash.hash_1 << 36) >> 36); // NOLINT
     DecodeEdgesHash(new_cube, ((hash.hash_1 >> 28) << 8) | uint64_t(hash.hash_2)); // NOLINT
+    new_cube.SetHash(hash);
+    return new_cube;
+}
+
+
+void Cube::SetHash (Hash hash) {
+    corner_hash_ = (hash.hash_1 << 36) >> 36; // NOLINT
+    calculated_corner_hash_ = true;
+    edge_hash_ = ((hash.hash_1 >> 28) << 8) | uint64_t(hash.hash_2); // NOLINT
+    calculated_edge_hash_ = true;
+    hash_ = hash;
+    calculated_hash_ = true;
+}
+
+
+// corners: 3 bit position and 2 bit orientation
+// edges: 4 bit position and 1 bit orientation
+// corners and the first 4 edges fill the low 60 bits, the other 8 edges the next 40 bits
+constexpr int kPackedPieceBits = 5;
+constexpr int kPackedLowEdges = 4;
+
+
+Cube::Packed Cube::GetPacked () const {
+    uint64_t low = 0;
+    uint64_t high = 0;
+    for (unsigned int i = 0; i < kNumCorners; i++) {
+        uint64_t piece = corners[i].position | (std::countr_zero(corners[i].orientation) << 3);
+        low |= piece << (kPackedPieceBits * i);
+    }
+    for (unsigned int i = 0; i < kNumEdges; i++) {
+        uint64_t piece = edges[i].position | (edges[i].orientation << 4);
+        if (i < kPackedLowEdges) {
+            low |= piece << (kPackedPieceBits * (kNumCorners + i));
+        }
+        else {
+            high |= piece << (kPackedPieceBits * (i - kPackedLowEdges));
+        }
+    }
+
+    Packed packed;
+    std::memcpy(packed.data.data(), &low, sizeof(low));
+    std::memcpy(packed.data.data() + sizeof(low), &high, packed.data.size() - sizeof(low));
+    return packed;
+}
+
+
+Cube UnpackCube (const Cube::Packed& packed, Cube::Hash hash) {
+    uint64_t low = 0;
+    uint64_t high = 0;
+    std::memcpy(&low, packed.data.data(), sizeof(low));
+    std::memcpy(&high, packed.data.data() + sizeof(low), packed.data.size() - sizeof(low));
+
+    const uint64_t piece_mask = (1 << kPackedPieceBits) - 1;
+    Cube new_cube;
+    for (unsigned int i = 0; i < Cube::kNumCorners; i++) {
+        uint64_t piece = (low >> (kPackedPieceBits * i)) & piece_mask;
+        new_cube.corners[i].position = piece & 7; // NOLINT
+        new_cube.corners[i].orientation = 1 << (piece >> 3);
+    }
+    for (unsigned int i = 0; i < Cube::kNumEdges; i++) {
+        uint64_t piece = i < kPackedLowEdges ? low >> (kPackedPieceBits * (Cube::kNumCorners + i)) : high >> (kPackedPieceBits * (i - kPackedLowEdges));
+        new_cube.edges[i].position = piece & 15; // NOLINT
+        new_cube.edges[i].orientation = (piece >> 4) & 1;
+    }
+    new_cube.SetHash(hash);
     return new_cube;
 }
 
@@ -13,6 +13,13 @@ void InitializePositionData (ErrorHandler& error_handler, Setting& settings);
 
 void InitializeEdgeData (ErrorHandler& error_handler, Setting& settings);
 
+// kNumPositions and kNumEdgePositions entries of the loaded tables
+const uint16_t* PositionDataTable ();
+const uint8_t* EdgeDataTable ();
+
+// reads the tables from memory owned by the caller, e.g. the shared tables, and frees the loaded ones
+void UsePatternTables (const uint16_t* position_data, const uint8_t* edge_data);
+
 
 constexpr int kNumPositions = 88179840; // 8! * 3^7
 constexpr int kNumEdgePositions = 42577920; // fac(12) / fac(6) * 2^6
@@ -56,6 +63,14 @@ public:
     };
     #pragma pack(pop)
 
+    // 13 byte representation of the pieces, 5 bits per piece
+    // larger than the hash but much faster to decode
+    #pragma pack(push, 1)
+    struct Packed {
+        std::array<uint8_t, 13> data;
+    };
+    #pragma pack(pop)
+
     // corners
     static const unsigned int kNumCorners = 8;
     std::array<Piece, kNumCorners> corners;
@@ -68,6 +83,11 @@ public:
     unsigned int GetCornerHash ();
     uint64_t GetEdgeHash ();
     Hash GetHash ();
+
+    Packed GetPacked () const;
+
+    // hash is already known, e.g. the cube got decoded from it
+    void SetHash (Hash hash);
     
     // new position resets computed data
     void SetNewPosition () {
@@ -118,3 +138,6 @@ private:
 
 // get cube from hash
 Cube DecodeHash (Cube::Hash hash);
+
+// get cube from its packed pieces and its hash
+Cube UnpackCube (const Cube::Packed& packed, Cube::Hash hash);
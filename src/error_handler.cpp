@@ -3,6 +3,8 @@
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <mutex>
+#include <ostream>
 #include <string>
 
 
@@ -24,45 +26,49 @@ void ErrorHandler::Handle(Level level, std::string file, std::string message) co
     if (level > error_level) {
         return;
     }
+    // concurrent solves share the output, ctime and strtok are not thread safe either
+    static std::mutex output_mutex;
+    std::lock_guard<std::mutex> guard(output_mutex);
+    std::ostream& output = use_stderr ? std::cerr : std::cout;
 
     // set color
-    std::cout << "\033[" << kColor[level] << "m";
+    output << "\033[" << kColor[level] << "m";
 
     std::time_t time = std::time(nullptr);
-    std::cout << "[" << std::strtok(std::ctime(&time), "\n") << "] ";
+    output << "[" << std::strtok(std::ctime(&time), "\n") << "] ";
     
     switch (level) {
         case Level::kCriticalError:
-            std::cout << "CRITICAL ERROR: ";
+            output << "CRITICAL ERROR: ";
             break;
         case Level::kError:
-            std::cout << "ERROR: ";
+            output << "ERROR: ";
             break;
         case Level::kWarning:
-            std::cout << "WARNING: ";
+            output << "WARNING: ";
             break;
         case Level::kInfo:
-            std::cout << "INFO: ";
+            output << "INFO: ";
             break;
         case Level::kAll:
             break;
         case Level::kExtra:
-            std::cout << "Extra: ";
+            output << "Extra: ";
             break;
         case Level::kMemory:
-            std::cout << "Memory: ";
+            output << "Memory: ";
             break;
     }
 
     if (level <= Level::kWarning) {
-        std::cout << "in file: " << file << " --- ";
+        output << "in file: " << file << " --- ";
     }
 
-    std::cout << message;
+    output << message;
 
-    std::cout << "\033[0m";
+    output << "\033[0m";
 
-    std::cout << std::endl;
+    output << std::endl;
 
     if (level == Level::kCriticalError) {
         exit(-1);
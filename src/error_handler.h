@@ -16,6 +16,8 @@ public:
     };
 
     Level error_level;
+    // the messages go to stderr, e.g. while stdout carries json lines
+    bool use_stderr = false;
 
     ErrorHandler(Level level) {
         SetErrorLevel(level);
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "ida_search.h"
+#include "rotation.h"
+#include "search.h"
+#include "settings.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+
+
+// positions at the root of the search tree that are shared between the threads
+constexpr int kMaxRootDepth = 4;
+constexpr int kRootsPerThread = 32;
+constexpr int kMaxIdaDepth = 100;
+constexpr uint64_t kPositionBatch = 1024;
+
+
+struct IdaRoot {
+    Cube::Hash hash;
+    uint8_t depth;
+    std::array<Rotations, kMaxRootDepth> rotations;
+};
+
+
+struct IdaState {
+    std::vector<IdaRoot> roots;
+    std::atomic<size_t> next_root;
+
+    int bound;
+    // smallest f value above the bound
+    std::atomic<int> next_bound;
+
+    std::atomic<uint64_t> num_positions;
+    std::atomic<bool> stop;
+    SolveStop* solve_stop;
+
+    // solution
+    std::mutex solution_mutex;
+    bool found = false;
+    Cube::Hash solution_cube;
+    std::vector<Rotations> solution;
+};
+
+
+// lower bound of the rotations needed to reach the outermost tablebase
+int IdaHeuristic (Cube& cube) {
+    return std::max(std::max({cube.GetCornerHeuristic(), int(cube.GetEdgeHeuristic1()), int(cube.GetEdgeHeuristic2())}) - GetTablebaseDepth(), 0);
+}
+
+
+bool IdaDfs (Setting& settings, IdaState& state, Cube& cube, int depth, Rotations last_rotation, std::vector<Rotations>& path, uint64_t& num_positions) {
+    if (++num_positions % kPositionBatch == 0) {
+        state.num_positions += kPositionBatch;
+        if (state.num_positions >= settings.max_num_positions || state.solve_stop->StopRequested()) {
+            state.stop = true;
+        }
+    }
+    if (state.stop) {
+        return false;
+    }
+
+    int f_value = depth + IdaHeuristic(cube);
+    if (f_value > state.bound) {
+        int next_bound = state.next_bound;
+        while (f_value < next_bound && !state.next_bound.compare_exchange_weak(next_bound, f_value)) {}
+        return false;
+    }
+
+    if (TablebaseContainsOuter(cube.GetHash())) {
+        std::lock_guard<std::mutex> guard(state.solution_mutex);
+        if (!state.found) {
+            state.found = true;
+            state.solution_cube = cube.GetHash();
+            state.solution = path;
+        }
+        state.stop = true;
+        return true;
+    }
+
+    if (depth >= kMaxIdaDepth) {
+        return false;
+    }
+
+    for (Rotations rotation : GetLegalRotations(cube)) {
+        if (last_rotation != Rotations(-1) && rotation == CounterRotation(last_rotation)) {
+            continue;
+        }
+        Cube next_cube = Rotate(cube, rotation);
+        path.push_back(rotation);
+        if (IdaDfs(settings, state, next_cube, depth+1, rotation, path, num_positions)) {
+            return true;
+        }
+        path.pop_back();
+    }
+    return false;
+}
+
+
+// threads take the roots one after another
+void IdaSearch (Setting& settings, IdaState& state) {
+    uint64_t num_positions = 0;
+    std::vector<Rotations> path;
+    while (!state.stop) {
+        size_t root_index = state.next_root++;
+        if (root_index >= state.roots.size()) {
+            break;
+        }
+        IdaRoot& root = state.roots[root_index];
+        path.assign(root.rotations.begin(), root.rotations.begin() + root.depth);
+        Cube cube = DecodeHash(root.hash);
+        IdaDfs(settings, state, cube, root.depth, root.depth == 0 ? Rotations(-1) : root.rotations[root.depth-1], path, num_positions);
+    }
+    state.num_positions += num_positions % kPositionBatch;
+}
+
+
+// breadth first search of the first rotations
+// returns true if the outermost tablebase is reached on the way
+bool IdaRoots (Setting& settings, IdaState& state, Cube start_cube) {
+    state.roots = {{start_cube.GetHash(), 0, {}}};
+    size_t num_roots = size_t(settings.num_threads) * kRootsPerThread;
+
+    for (int depth = 0; depth < kMaxRootDepth && state.roots.size() < num_roots; depth++) {
+        std::vector<IdaRoot> next_roots;
+        for (IdaRoot& root : state.roots) {
+            Cube cube = DecodeHash(root.hash);
+            for (Rotations rotation : GetLegalRotations(cube)) {
+                if (depth > 0 && rotation == CounterRotation(root.rotations[depth-1])) {
+                    continue;
+                }
+                Cube next_cube = Rotate(cube, rotation);
+                Cube::Hash next_hash = next_cube.GetHash();
+                state.num_positions++;
+
+                IdaRoot next_root = root;
+                next_root.hash = next_hash;
+                next_root.rotations[depth] = rotation;
+                next_root.depth = depth+1;
+
+                // nothing closer to the tablebase can be found at this depth
+                if (TablebaseContainsOuter(next_hash)) {
+                    state.found = true;
+                    state.solution_cube = next_hash;
+                    state.solution.assign(next_root.rotations.begin(), next_root.rotations.begin() + next_root.depth);
+                    return true;
+                }
+
+                next_roots.push_back(next_root);
+            }
+        }
+
+        // transpositions of the root would be searched twice
+        auto hash_less = [](const IdaRoot& a, const IdaRoot& b) {
+            return a.hash.hash_1 != b.hash.hash_1 ? a.hash.hash_1 < b.hash.hash_1 : a.hash.hash_2 < b.hash.hash_2;
+        };
+        auto hash_equal = [](const IdaRoot& a, const IdaRoot& b) {
+            return a.hash.hash_1 == b.hash.hash_1 && a.hash.hash_2 == b.hash.hash_2;
+        };
+        std::sort(next_roots.begin(), next_roots.end(), hash_less);
+        next_roots.erase(std::unique(next_roots.begin(), next_roots.end(), hash_equal), next_roots.end());
+        state.roots = std::move(next_roots);
+    }
+    return false;
+}
+
+
+bool IdaSolve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions, SolveStop& solve_stop) {
+    IdaState state;
+    state.num_positions = num_positions;
+    state.stop = false;
+    state.solve_stop = &solve_stop;
+
+    if (!IdaRoots(settings, state, start_cube)) {
+        int root_depth = state.roots.empty() ? 0 : state.roots[0].depth;
+        state.bound = std::max(IdaHeuristic(start_cube), root_depth);
+
+        while (!state.found && !state.stop && state.bound <= kMaxIdaDepth && state.num_positions < settings.max_num_positions) {
+            error_handler.Handle(ErrorHandler::Level::kExtra, "ida_search.cpp", "search depth " + std::to_string(state.bound + GetTablebaseDepth()) + " visiting " + std::to_string(state.num_positions) + " positions");
+            state.next_root = 0;
+            state.next_bound = kMaxIdaDepth + 1;
+            // the workers of the thread pool share the roots
+            GetThreadPool(settings).Run(settings.num_threads, [&settings, &state]([[maybe_unused]] int worker) {
+                IdaSearch(settings, state);
+            });
+            state.bound = state.next_bound;
+        }
+    }
+    num_positions = state.num_positions;
+
+    if (solve_stop.DeadlineReached()) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "ida_search.cpp", "time limit reached after " + std::to_string(num_positions) + " positions");
+    }
+    if (!state.found) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "ida_search.cpp", "Did not find a solution within " + std::to_string(num_positions) + " positions");
+        return false;
+    }
+    error_handler.Handle(ErrorHandler::Level::kInfo, "ida_search.cpp", "found optimal solution");
+    actions.solve_optimal = true;
+
+    Cube cube = DecodeHash(state.solution_cube);
+    TablebaseSolve(cube, actions, TablebaseDepth(cube)+1, num_positions);
+    for (auto rotation = state.solution.rbegin(); rotation != state.solution.rend(); rotation++) {
+        actions.solve.push(*rotation);
+    }
+    return true;
+}
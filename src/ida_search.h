@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "search.h"
+#include "settings.h"
+
+
+// iterative deepening A* from the start position to the outermost tablebase
+bool IdaSolve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions, SolveStop& solve_stop);
@@ -7,6 +7,7 @@
 #include "actions.h"
 #include "cube.h"
 #include "error_handler.h"
+#include "puppet_cube.h"
 #include "settings.h"
 #include "rotation.h"
 #include "search_manager.h"
@@ -44,13 +45,12 @@ int main (int argc, char *argv[]) {
     // get reproducible random numbers
     rng.seed(0);
 
-    // load legal moves from file
-    InitializePositionData(error_handler, settings);
-    InitializeEdgeData(error_handler, settings);
+    // load legal moves from file and build the tablebase
+    PuppetCube puppet_cube(error_handler, settings);
 
     error_handler.Handle(ErrorHandler::Level::kMemory, "main.cpp", "currently using " + std::to_string(getCurrentRSS()/1000000) + " MB"); // NOLINT
     // start the search manager
-    SearchManager(error_handler, settings, actions, rng);
+    SearchManager(error_handler, settings, actions, rng, puppet_cube);
 
     // wait until the window manager has finished
     if (settings.gui) {
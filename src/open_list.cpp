@@ -0,0 +1,572 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <concurrentqueue.h>
+
+
+#include "open_list.h"
+
+
+OpenList::OpenList (const Setting& settings) :
+        queues_(kNumQueues * kNumBoundKeys),
+        allocated_(kNumQueues),
+        counts_(kNumQueues) {
+    if (settings.spill_dir.empty()) {
+        return;
+    }
+    runs_.resize(queues_.size());
+    for (std::unique_ptr<SpillRun>& run : runs_) {
+        run = std::make_unique<SpillRun>();
+    }
+    // several searches may share the directory
+    std::stringstream prefix;
+    prefix << settings.spill_dir << "/queue_" << std::hex << std::random_device()() << std::random_device()() << "_";
+    spill_prefix_ = prefix.str();
+    memory_limit_ = (uint64_t(settings.spill_memory) << 20) / sizeof(CubeSearch); // NOLINT
+    spilling_ = true;
+}
+
+
+OpenList::~OpenList () {
+    for (std::atomic<Queue*>& queue : queues_) {
+        delete queue.load();
+    }
+    for (Queue* queue : pool_) {
+        delete queue;
+    }
+    for (int index = 0; index < int(runs_.size()); index++) {
+        RemoveRun(index);
+    }
+}
+
+
+void OpenList::Push (const CubeSearch& cube_search, int bound_key) {
+    bound_key = std::min(bound_key, kNumBoundKeys-1);
+    // the position cannot lead to a shorter solution anymore
+    if (bound_key >= bound_.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    int index = cube_search.heuristic * kNumBoundKeys + bound_key;
+    std::atomic<Queue*>& queue = queues_[index];
+    Queue* current = queue.load(std::memory_order_acquire);
+    if (current == nullptr) {
+        Queue* created = NewQueue();
+        if (queue.compare_exchange_strong(current, created, std::memory_order_acq_rel)) {
+            current = created;
+            allocated_[cube_search.heuristic][bound_key / kMaskBits] |= uint64_t(1) << (bound_key % kMaskBits);
+        }
+        // another thread was faster
+        else {
+            std::lock_guard<std::mutex> guard(pool_mutex_);
+            pool_.push_back(created);
+        }
+    }
+
+    // counted before it can be popped, so the size never drops to 0 too early
+    ++size_;
+    ++counts_[cube_search.heuristic];
+    if (spilling_ && in_memory_ >= memory_limit_) {
+        Spill(index, cube_search);
+    }
+    else {
+        if (spilling_) {
+            ++in_memory_;
+        }
+        current->enqueue(cube_search);
+    }
+
+    // pairs with the fence of a worker going to sleep: it either sees the position or gets woken
+    // and with the fence of Prune: it either drops the position or this push sees the new bound
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (bound_key >= bound_.load(std::memory_order_relaxed)) {
+        if (DropQueue(index) != 0 && size_ == 0) {
+            Wake(true);
+        }
+        return;
+    }
+    if (sleepers_.load(std::memory_order_relaxed) > 0) {
+        Wake(false);
+    }
+}
+
+
+bool OpenList::TryPop (CubeSearch& cube_search) {
+    // counted before looking at the pause, so Pause either waits for this worker or it sees the pause
+    ++expanding_;
+    if (paused_) {
+        --expanding_;
+        return false;
+    }
+    int bound = bound_.load(std::memory_order_relaxed);
+    for (int heuristic = 0; heuristic < kNumQueues; heuristic++) {
+        if (counts_[heuristic].load(std::memory_order_relaxed) <= 0) {
+            continue;
+        }
+        // deeper positions first
+        for (int mask = kNumMasks-1; mask >= 0; mask--) {
+            uint64_t allocated = allocated_[heuristic][mask].load(std::memory_order_acquire);
+            while (allocated != 0) {
+                int bit = std::bit_width(allocated) - 1;
+                allocated ^= uint64_t(1) << bit;
+                int bound_key = mask * kMaskBits + bit;
+                int index = heuristic * kNumBoundKeys + bound_key;
+                // a push racing with Prune created the queue behind the bound
+                if (bound_key >= bound) {
+                    if (DropQueue(index) != 0 && size_ == 0) {
+                        Wake(true);
+                    }
+                    continue;
+                }
+                Queue* queue = queues_[index].load(std::memory_order_acquire);
+                if (queue == nullptr) {
+                    continue;
+                }
+                // the queue in memory comes first, then the next block of its run
+                if (queue->try_dequeue(cube_search) || (Reload(index, heuristic) && queue->try_dequeue(cube_search))) {
+                    --counts_[heuristic];
+                    if (spilling_) {
+                        --in_memory_;
+                    }
+                    return true;
+                }
+            }
+        }
+    }
+    --expanding_;
+    return false;
+}
+
+
+bool OpenList::Pop (CubeSearch& cube_search) {
+    int round = 0;
+    while (true) {
+        if (TryPop(cube_search)) {
+            return true;
+        }
+        if (size_ == 0 || closed_) {
+            return false;
+        }
+        // other workers are still expanding positions, new ones may follow soon
+        if (++round < kSpinRounds) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        uint32_t epoch = epoch_.load();
+        ++sleepers_;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // look again after announcing to sleep, a push from now on wakes this worker
+        bool found = TryPop(cube_search);
+        if (!found && size_ != 0 && !closed_) {
+            epoch_.wait(epoch);
+        }
+        --sleepers_;
+        if (found) {
+            return true;
+        }
+        round = 0;
+    }
+}
+
+
+void OpenList::Done () {
+    --expanding_;
+    // the last position got searched
+    if (--size_ == 0) {
+        Wake(true);
+    }
+}
+
+
+uint64_t OpenList::Prune (int bound) {
+    bound = std::max(bound, 0);
+    int old_bound = bound_.load();
+    if (bound >= old_bound) {
+        return 0;
+    }
+    // pushes from now on drop the position themselves, the earlier ones are drained below
+    bound_.store(bound);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t num_dropped = 0;
+    for (int heuristic = 0; heuristic < kNumQueues; heuristic++) {
+        for (int bound_key = bound; bound_key < old_bound; bound_key++) {
+            num_dropped += DropQueue(heuristic * kNumBoundKeys + bound_key);
+        }
+    }
+
+    // the dropped positions may have been the last ones
+    if (num_dropped != 0 && size_ == 0) {
+        Wake(true);
+    }
+    return num_dropped;
+}
+
+
+uint64_t OpenList::DropQueue (int index) {
+    int heuristic = index / kNumBoundKeys;
+    int bound_key = index % kNumBoundKeys;
+    // workers stop looking at the queue
+    allocated_[heuristic][bound_key / kMaskBits] &= ~(uint64_t(1) << (bound_key % kMaskBits));
+
+    uint64_t num_dropped = 0;
+    // the run first, a reload holding its mutex moves its block into the queue drained below
+    if (!runs_.empty()) {
+        SpillRun& run = *runs_[index];
+        std::lock_guard<std::mutex> guard(run.mutex);
+        num_dropped += run.size;
+        // blocks being written are skipped once they are on disk, the file is removed after them
+        // a snapshot may still read the file
+        if (run.num_writing != 0 || snapshot_) {
+            run.num_dropped_writing = run.num_writing;
+            run.num_read = run.num_written;
+            run.buffer = std::vector<CubeSearch>();
+            run.size = 0;
+        }
+        else {
+            RemoveRun(index);
+        }
+    }
+    Queue* queue = queues_[index].load(std::memory_order_acquire);
+    if (queue != nullptr) {
+        std::array<CubeSearch, kDropBlock> block;
+        uint64_t num_in_memory = 0;
+        while (size_t num_block = queue->try_dequeue_bulk(block.begin(), block.size())) {
+            num_in_memory += num_block;
+        }
+        if (spilling_) {
+            in_memory_ -= num_in_memory;
+        }
+        num_dropped += num_in_memory;
+    }
+    counts_[heuristic] -= num_dropped;
+    size_ -= num_dropped;
+    return num_dropped;
+}
+
+
+void OpenList::Close () {
+    closed_ = true;
+    Wake(true);
+}
+
+
+void OpenList::Reset () {
+    std::vector<CubeSearch> block(kSpillBlock);
+    for (int index = 0; index < int(queues_.size()); index++) {
+        Queue* queue = queues_[index].exchange(nullptr);
+        if (queue == nullptr) {
+            continue;
+        }
+        // dequeued blocks stay with the queue for the next positions
+        while (queue->try_dequeue_bulk(block.begin(), block.size()) != 0) {
+        }
+        pool_.push_back(queue);
+    }
+    for (int index = 0; index < int(runs_.size()); index++) {
+        RemoveRun(index);
+    }
+    for (std::array<std::atomic<uint64_t>, kNumMasks>& allocated : allocated_) {
+        for (std::atomic<uint64_t>& mask : allocated) {
+            mask = 0;
+        }
+    }
+    for (std::atomic<int64_t>& count : counts_) {
+        count = 0;
+    }
+    bound_ = kNumBoundKeys;
+    size_ = 0;
+    closed_ = false;
+    expanding_ = 0;
+    paused_ = false;
+    in_memory_ = 0;
+    spilling_ = !runs_.empty();
+    spill_failed_ = false;
+}
+
+
+OpenList::Queue* OpenList::NewQueue () {
+    {
+        std::lock_guard<std::mutex> guard(pool_mutex_);
+        if (!pool_.empty()) {
+            Queue* queue = pool_.back();
+            pool_.pop_back();
+            return queue;
+        }
+    }
+    return new Queue();
+}
+
+
+void OpenList::Pause () {
+    paused_ = true;
+    // workers that counted themselves before the pause finish their position or give up looking
+    while (expanding_ != 0) {
+        std::this_thread::yield();
+    }
+}
+
+
+void OpenList::Resume () {
+    paused_ = false;
+    Wake(true);
+}
+
+
+std::vector<OpenList::QueueSnapshot> OpenList::Snapshot () {
+    snapshot_ = true;
+    std::vector<QueueSnapshot> snapshot;
+    for (int index = 0; index < int(queues_.size()); index++) {
+        QueueSnapshot queue_snapshot;
+        queue_snapshot.index = index;
+        queue_snapshot.bound_key = index % kNumBoundKeys;
+        // a queue cannot be iterated, so its positions are dequeued and enqueued again in the same order
+        Queue* queue = queues_[index].load();
+        if (queue != nullptr) {
+            queue_snapshot.positions.resize(queue->size_approx());
+            size_t num_positions = queue->try_dequeue_bulk(queue_snapshot.positions.begin(), queue_snapshot.positions.size());
+            queue_snapshot.positions.resize(num_positions);
+            queue->enqueue_bulk(queue_snapshot.positions.begin(), num_positions);
+        }
+        if (!runs_.empty()) {
+            SpillRun& run = *runs_[index];
+            queue_snapshot.positions.insert(queue_snapshot.positions.end(), run.buffer.begin(), run.buffer.end());
+            queue_snapshot.first_spilled = run.num_read;
+            queue_snapshot.end_spilled = run.num_written;
+        }
+        if (!queue_snapshot.positions.empty() || queue_snapshot.first_spilled != queue_snapshot.end_spilled) {
+            snapshot.push_back(std::move(queue_snapshot));
+        }
+    }
+    return snapshot;
+}
+
+
+bool OpenList::ForEachSpilled (const QueueSnapshot& queue, const std::function<void (const std::vector<CubeSearch>&)>& visit) const {
+    // the run files are only appended to during the snapshot, so the noted part is unchanged
+    std::vector<CubeSearch> block;
+    for (uint64_t first = queue.first_spilled; first < queue.end_spilled; first += kSpillBlock) {
+        if (!ReadRun(queue.index, first, std::min<uint64_t>(kSpillBlock, queue.end_spilled - first), block)) {
+            return false;
+        }
+        visit(block);
+    }
+    return true;
+}
+
+
+void OpenList::EndSnapshot () {
+    snapshot_ = false;
+    // used up files kept for the snapshot
+    for (int index = 0; index < int(runs_.size()); index++) {
+        SpillRun& run = *runs_[index];
+        std::lock_guard<std::mutex> guard(run.mutex);
+        if (run.num_written != 0 && run.num_read == run.num_written && run.num_writing == 0) {
+            CloseRun(index);
+            run.num_written = 0;
+            run.num_read = 0;
+        }
+    }
+}
+
+
+void OpenList::Wake (bool all) {
+    ++epoch_;
+    if (all) {
+        epoch_.notify_all();
+    }
+    else {
+        epoch_.notify_one();
+    }
+}
+
+
+void OpenList::Spill (int index, const CubeSearch& cube_search) {
+    SpillRun& run = *runs_[index];
+    std::vector<CubeSearch> block;
+    {
+        std::lock_guard<std::mutex> guard(run.mutex);
+        run.buffer.push_back(cube_search);
+        ++run.size;
+        if (run.buffer.size() < kSpillBlock) {
+            return;
+        }
+        block.swap(run.buffer);
+        run.num_writing += block.size();
+    }
+
+    // other pushes and reloads of the run go on while the block is written
+    bool written = WriteRun(index, block);
+
+    std::lock_guard<std::mutex> guard(run.mutex);
+    run.num_writing -= block.size();
+    uint64_t num_dropped = std::min<uint64_t>(run.num_dropped_writing, block.size());
+    run.num_dropped_writing -= num_dropped;
+    // blocks are appended in the order they get written, so the first positions of the file are complete
+    if (written) {
+        run.num_written += block.size();
+        run.num_read += num_dropped;
+        return;
+    }
+    // keep the positions in memory, the part of the file written so far cannot be trusted
+    spill_failed_ = true;
+    spilling_ = false;
+    run.buffer.insert(run.buffer.end(), block.begin() + num_dropped, block.end());
+}
+
+
+bool OpenList::WriteRun (int index, const std::vector<CubeSearch>& block) {
+    SpillRun& run = *runs_[index];
+    std::lock_guard<std::mutex> guard(run.file_mutex);
+    if (run.file_failed) {
+        return false;
+    }
+    if (run.file == nullptr) {
+        run.file = std::fopen(RunPath(index).c_str(), "w+b");
+        run.file_size = 0;
+    }
+    bool written = run.file != nullptr && std::fseek(run.file, long(run.file_size * sizeof(CubeSearch)), SEEK_SET) == 0 &&
+                   std::fwrite(block.data(), sizeof(CubeSearch), block.size(), run.file) == block.size();
+    if (!written) {
+        run.file_failed = true;
+        return false;
+    }
+    run.file_size += block.size();
+    return true;
+}
+
+
+bool OpenList::Reload (int index, int heuristic) {
+    if (runs_.empty() || runs_[index]->size == 0) {
+        return false;
+    }
+    SpillRun& run = *runs_[index];
+    // another worker is already reading the run
+    std::unique_lock<std::mutex> lock(run.mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
+    }
+
+    std::vector<CubeSearch> block;
+    if (run.num_read < run.num_written) {
+        uint64_t num_block = std::min<uint64_t>(kSpillBlock, run.num_written - run.num_read);
+        bool read = ReadRun(index, run.num_read, num_block, block);
+        run.num_read += num_block;
+        run.size -= num_block;
+        // the positions are lost
+        if (!read) {
+            spill_failed_ = true;
+            counts_[heuristic] -= num_block;
+            if ((size_ -= num_block) == 0) {
+                Wake(true);
+            }
+            return false;
+        }
+    }
+    // the file is used up, so the buffer follows
+    else {
+        // it starts over unless a block is being appended or a snapshot still reads it
+        if (run.num_written != 0 && run.num_writing == 0 && !snapshot_) {
+            CloseRun(index);
+            run.num_written = 0;
+            run.num_read = 0;
+        }
+        block.swap(run.buffer);
+        run.size -= block.size();
+    }
+    if (block.empty()) {
+        return false;
+    }
+
+    // delayed duplicate detection: equal positions of the run are merged into one
+    std::sort(block.begin(), block.end(), [](const CubeSearch& a, const CubeSearch& b) {
+        if (a.hash.hash_1 != b.hash.hash_1) {
+            return a.hash.hash_1 < b.hash.hash_1;
+        }
+        if (a.hash.hash_2 != b.hash.hash_2) {
+            return a.hash.hash_2 < b.hash.hash_2;
+        }
+        if (a.depth != b.depth) {
+            return a.depth < b.depth;
+        }
+        return a.visited_time < b.visited_time;
+    });
+    size_t num_unique = 0;
+    for (const CubeSearch& cube_search : block) {
+        if (num_unique != 0) {
+            CubeSearch& last = block[num_unique-1];
+            if (last.hash.hash_1 == cube_search.hash.hash_1 && last.hash.hash_2 == cube_search.hash.hash_2 &&
+                last.depth == cube_search.depth && last.visited_time == cube_search.visited_time) {
+                // a requeued position has to generate the children pending in any copy
+                last.SetPendingRotations(last.PendingRotations() | cube_search.PendingRotations());
+                continue;
+            }
+        }
+        block[num_unique++] = cube_search;
+    }
+    // at least one position is left, so the size cannot drop to 0 here
+    uint64_t num_merged = block.size() - num_unique;
+    counts_[heuristic] -= num_merged;
+    size_ -= num_merged;
+    if (spilling_) {
+        in_memory_ += num_unique;
+    }
+    queues_[index].load(std::memory_order_acquire)->enqueue_bulk(block.begin(), num_unique);
+    lock.unlock();
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0) {
+        Wake(true);
+    }
+    return true;
+}
+
+
+bool OpenList::ReadRun (int index, uint64_t first, uint64_t num, std::vector<CubeSearch>& block) const {
+    SpillRun& run = *runs_[index];
+    block.resize(num);
+    std::lock_guard<std::mutex> guard(run.file_mutex);
+    return run.file != nullptr && std::fseek(run.file, long(first * sizeof(CubeSearch)), SEEK_SET) == 0 &&
+           std::fread(block.data(), sizeof(CubeSearch), num, run.file) == num;
+}
+
+
+void OpenList::CloseRun (int index) {
+    SpillRun& run = *runs_[index];
+    std::lock_guard<std::mutex> guard(run.file_mutex);
+    if (run.file != nullptr) {
+        std::fclose(run.file);
+        std::remove(RunPath(index).c_str());
+        run.file = nullptr;
+    }
+    run.file_size = 0;
+    run.file_failed = false;
+}
+
+
+void OpenList::RemoveRun (int index) {
+    SpillRun& run = *runs_[index];
+    CloseRun(index);
+    run.buffer.clear();
+    run.buffer.shrink_to_fit();
+    run.num_written = 0;
+    run.num_read = 0;
+    run.num_writing = 0;
+    run.num_dropped_writing = 0;
+    run.size = 0;
+}
+
+
+std::string OpenList::RunPath (int index) const {
+    return spill_prefix_ + std::to_string(index) + ".bin";
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <concurrentqueue.h>
+
+
+#include "cube.h"
+#include "settings.h"
+
+
+#pragma pack(push, 1)
+struct CubeSearch {
+    // memory optimized representation of the cube
+    Cube::Hash hash;
+
+    uint8_t heuristic;
+    uint8_t depth;
+
+    // this is a value from 0 to 4 describing how often this position is been visited
+    uint8_t visited_time;
+
+    #ifdef PACKED_QUEUE
+    // decoding the pieces is faster than decoding the hash
+    Cube::Packed packed;
+    #endif
+
+    // partial expansion: one bit per rotation whose child has not been generated yet
+    std::array<uint8_t, 3> pending;
+
+    uint32_t PendingRotations () const {
+        return pending[0] | (uint32_t(pending[1]) << 8) | (uint32_t(pending[2]) << 16); // NOLINT
+    }
+
+    void SetPendingRotations (uint32_t rotations) {
+        pending = {uint8_t(rotations), uint8_t(rotations >> 8), uint8_t(rotations >> 16)}; // NOLINT
+    }
+
+    // sort priority_queue smaller to larger
+    bool operator<(const CubeSearch& cube_search) const {
+        if (heuristic != cube_search.heuristic) {
+            return heuristic > cube_search.heuristic;
+        }
+        if (hash.hash_1 != cube_search.hash.hash_1) {
+            return hash.hash_1 > cube_search.hash.hash_1;
+        }
+        return hash.hash_2 > cube_search.hash.hash_2;
+    }
+};
+#pragma pack(pop)
+
+
+// positions waiting to be searched, one queue per heuristic and bound key
+// the bound key depth + max(h - tablebase depth, 0) is a lower bound of the solution through the position,
+// so once a solution of this depth is known all queues of this and larger keys can be dropped at once
+// the queues of a heuristic are allocated when the first position arrives
+//
+// the size counts the queued positions and the ones a worker is still expanding,
+// so it only reaches 0 once the whole search space is exhausted
+// idle workers sleep on an epoch counter and get woken by new positions, a drained list or Close
+// a list is reused by the next search after Reset
+//
+// with a spill directory the positions beyond the memory budget are appended to one run file per queue
+// and read back in blocks once the queue in memory is empty
+// duplicates of a block are merged after sorting, the visited positions filter the rest when they are popped
+// only the open list is spilled, the visited positions stay in memory and need a fixed table to be bounded
+class OpenList {
+public:
+    OpenList (const Setting& settings);
+    ~OpenList ();
+
+    // positions with a bound key of at least the current bound are not stored
+    void Push (const CubeSearch& cube_search, int bound_key);
+
+    // waits for the next position
+    // returns false if the list is drained or closed
+    // every returned position has to be finished with Done after its children got pushed
+    bool Pop (CubeSearch& cube_search);
+
+    void Done ();
+
+    // drops all positions with a bound key of at least bound, pushing and popping go on meanwhile
+    // the drained queues are reused after Reset, only one thread may prune at a time
+    // returns the number of dropped positions
+    uint64_t Prune (int bound);
+
+    // wakes all waiting workers and lets Pop fail from now on
+    void Close ();
+
+    // empties the list for the next search, no worker may use it
+    // the queues are kept in a pool, so their blocks are reused
+    void Reset ();
+
+    // lets Pop wait and returns once every popped position is done
+    void Pause ();
+    void Resume ();
+
+    // positions of one queue copied by Snapshot
+    struct QueueSnapshot {
+        int index;
+        int bound_key;
+        // positions in memory and in the buffer of the run
+        std::vector<CubeSearch> positions;
+        // unread part of the run file
+        uint64_t first_spilled = 0;
+        uint64_t end_spilled = 0;
+    };
+
+    // copies the queues in memory and notes the unread part of every run file, only while paused
+    // the run files keep these parts until EndSnapshot, so they can be read after Resume
+    std::vector<QueueSnapshot> Snapshot ();
+
+    // calls visit for the noted part of the run file in blocks
+    // returns false if the run file could not be read
+    bool ForEachSpilled (const QueueSnapshot& queue, const std::function<void (const std::vector<CubeSearch>&)>& visit) const;
+
+    // run files may be used up and removed again
+    void EndSnapshot ();
+
+    // every position has been searched
+    bool Drained () const {
+        return size_ == 0;
+    }
+
+    // a run file could not be written or read back
+    // positions of a failed read are lost, so the search is not exhaustive anymore
+    bool SpillFailed () const {
+        return spill_failed_;
+    }
+
+    static constexpr int kNumQueues = 150;
+    // larger bound keys share the last queue
+    static constexpr int kNumBoundKeys = 128;
+
+private:
+    using Queue = moodycamel::ConcurrentQueue<CubeSearch>;
+
+    // scans of the queues before a worker goes to sleep
+    static constexpr int kSpinRounds = 16;
+    static constexpr int kMaskBits = 64;
+    static constexpr int kNumMasks = kNumBoundKeys / kMaskBits;
+    // positions written or read at once
+    static constexpr size_t kSpillBlock = size_t(1) << 12;
+    // positions dequeued at once when a queue is dropped
+    static constexpr size_t kDropBlock = 256;
+
+    // positions of one queue on disk and the ones waiting to be written
+    struct SpillRun {
+        std::mutex mutex;
+        std::vector<CubeSearch> buffer;
+        uint64_t num_written = 0;
+        uint64_t num_read = 0;
+        // positions of blocks taken out of the buffer and not written yet
+        uint64_t num_writing = 0;
+        // positions of these blocks dropped by Prune, they are skipped once written
+        uint64_t num_dropped_writing = 0;
+        // buffered, writing and unread positions
+        std::atomic<uint64_t> size = 0;
+
+        // the file stays open as long as the run has positions on disk
+        // lock order: mutex before file_mutex, a block is written holding only file_mutex
+        std::mutex file_mutex;
+        std::FILE* file = nullptr;
+        uint64_t file_size = 0;
+        bool file_failed = false;
+    };
+
+    bool TryPop (CubeSearch& cube_search);
+
+    // removes the positions of a queue behind the bound, any thread may call it for the same queue
+    // returns the number of removed positions
+    uint64_t DropQueue (int index);
+
+    // empty queue from the pool or a new one
+    Queue* NewQueue ();
+
+    void Spill (int index, const CubeSearch& cube_search);
+
+    // appends the block to the run file
+    bool WriteRun (int index, const std::vector<CubeSearch>& block);
+
+    // reads num positions of the run file starting at first
+    bool ReadRun (int index, uint64_t first, uint64_t num, std::vector<CubeSearch>& block) const;
+
+    // moves the next block of the run file into the queue
+    // returns false if no position was moved
+    bool Reload (int index, int heuristic);
+
+    // closes and removes the run file, called with the run mutex and no block being written
+    void CloseRun (int index);
+
+    // removes the run file and its positions, called with the run mutex and no block being written
+    // or while no other thread uses the list
+    void RemoveRun (int index);
+
+    std::string RunPath (int index) const;
+
+    void Wake (bool all);
+
+    // queue of the heuristic and bound key, nullptr if not allocated
+    std::vector<std::atomic<Queue*>> queues_;
+    // allocated bound keys of every heuristic
+    std::vector<std::array<std::atomic<uint64_t>, kNumMasks>> allocated_;
+    // queued positions of every heuristic
+    std::vector<std::atomic<int64_t>> counts_;
+
+    // positions with a bound key of at least bound_ are dropped, it only decreases until Reset
+    std::atomic<int> bound_ = kNumBoundKeys;
+
+    std::atomic<uint64_t> size_ = 0;
+    std::atomic<bool> closed_ = false;
+    std::atomic<uint32_t> epoch_ = 0;
+    std::atomic<int> sleepers_ = 0;
+    // popped positions not done yet and workers looking for one
+    std::atomic<int> expanding_ = 0;
+    std::atomic<bool> paused_ = false;
+
+    // drained queues of earlier searches
+    std::mutex pool_mutex_;
+    std::vector<Queue*> pool_;
+
+    // one run per queue if spilling is enabled
+    std::vector<std::unique_ptr<SpillRun>> runs_;
+    std::string spill_prefix_;
+    uint64_t memory_limit_ = 0;
+    std::atomic<uint64_t> in_memory_ = 0;
+    std::atomic<bool> spilling_ = false;
+    // a snapshot still has to read the run files
+    std::atomic<bool> snapshot_ = false;
+    std::atomic<bool> spill_failed_ = false;
+};
@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stack>
+#include <vector>
+
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "puppet_cube.h"
+#include "rotation.h"
+#include "search.h"
+#include "settings.h"
+#include "shared_tables.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+
+
+SolveState::SolveState ([[maybe_unused]] const PuppetCube& puppet_cube) : actions_(own_actions_) {}
+
+
+SolveState::SolveState ([[maybe_unused]] const PuppetCube& puppet_cube, Actions& actions) : actions_(actions) {}
+
+
+// the search state is complete here
+SolveState::~SolveState () = default;
+
+
+PuppetCube::PuppetCube (ErrorHandler error_handler, const Setting& settings) : error_handler_(error_handler), settings_(settings) {
+    // the tables are loaded once per process
+    static std::once_flag tables_loaded;
+    std::call_once(tables_loaded, [this]() {
+        if (!settings_.shared_tables.empty() && AttachSharedTables(error_handler_, settings_)) {
+            return;
+        }
+        InitializePositionData(error_handler_, settings_);
+        InitializeEdgeData(error_handler_, settings_);
+        TablebaseSearch(error_handler_, settings_, settings_.tablebase_depth);
+        // the next processes attach the tables instead of building them
+        if (!settings_.shared_tables.empty()) {
+            WriteSharedTables(error_handler_, settings_);
+        }
+    });
+    // a later context may need a deeper tablebase
+    TablebaseSearch(error_handler_, settings_, settings_.tablebase_depth);
+    // the pool gets all threads before a solve asks for a part of them
+    GetThreadPool(settings_);
+}
+
+
+SolveResult PuppetCube::Solve (SolveState& state, Cube start_cube, const SolveOptions& options) const {
+    Setting solve_settings = settings_;
+    if (options.time_limit_ms != 0) {
+        solve_settings.time_limit_ms = options.time_limit_ms;
+    }
+    if (options.max_num_positions != 0) {
+        solve_settings.max_num_positions = options.max_num_positions;
+    }
+    if (options.num_threads != 0) {
+        solve_settings.num_threads = options.num_threads;
+    }
+
+    SolveResult result;
+    auto start_time = std::chrono::steady_clock::now();
+    state.actions_.solve = std::stack<Rotations>();
+    result.solved = ::Solve(error_handler_, solve_settings, state.actions_, start_cube, result.num_positions, state.search_state_);
+    result.time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    result.optimal = result.solved && state.actions_.solve_optimal;
+    while (result.solved && !state.actions_.solve.empty()) {
+        result.solution.push_back(state.actions_.solve.top());
+        state.actions_.solve.pop();
+    }
+    state.actions_.solve = std::stack<Rotations>();
+    return result;
+}
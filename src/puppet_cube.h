@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "rotation.h"
+#include "settings.h"
+
+
+class PuppetCube;
+// visited table and open list of the astar search, only known to the library
+struct SearchState;
+
+
+// limits of one solve, 0 keeps the value of the settings of the context
+struct SolveOptions {
+    int64_t time_limit_ms = 0;
+    uint64_t max_num_positions = 0;
+    int num_threads = 0;
+};
+
+
+struct SolveResult {
+    bool solved = false;
+    // no shorter solution exists
+    bool optimal = false;
+    // rotations from the start position to the solved cube
+    std::vector<Rotations> solution;
+    uint64_t num_positions = 0;
+    double time_s = 0;
+};
+
+
+// search memory of one caller, its solves run one after another and reuse it
+class SolveState {
+public:
+    SolveState (const PuppetCube& puppet_cube);
+    // the solves also stop once actions.stop is set, e.g. when the window closes
+    SolveState (const PuppetCube& puppet_cube, Actions& actions);
+    ~SolveState ();
+
+    // stops the running solve from another thread, it keeps its best solution so far
+    void Cancel () {
+        actions_.cancel = true;
+    }
+
+    // a cancel belongs to one solve, the caller clears it before the next one
+    void ClearCancel () {
+        actions_.cancel = false;
+    }
+
+private:
+    friend class PuppetCube;
+
+    // created by the first astar solve
+    std::unique_ptr<SearchState> search_state_;
+    Actions own_actions_;
+    Actions& actions_;
+};
+
+
+// solver library: the context loads the pattern databases and builds the tablebase
+// the tables are shared by the whole process, so the context is created once before the first solve
+// and lives as long as solves run, every thread solves with its own SolveState
+class PuppetCube {
+public:
+    PuppetCube (ErrorHandler error_handler, const Setting& settings);
+
+    const Setting& Settings () const {
+        return settings_;
+    }
+
+    SolveResult Solve (SolveState& state, Cube start_cube, const SolveOptions& options = SolveOptions()) const;
+
+private:
+    ErrorHandler error_handler_;
+    Setting settings_;
+};
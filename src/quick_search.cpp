@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include <parallel_hashmap/phmap.h>
+
+
+#include "cube.h"
+#include "error_handler.h"
+#include "quick_search.h"
+#include "rotation.h"
+#include "search.h"
+#include "settings.h"
+#include "tablebase.h"
+#include "visited.h"
+
+
+constexpr int kMaxQuickDepth = 100;
+
+
+// depth and rotation leading to the position
+using QuickVisited = phmap::flat_hash_map<CubeMapVisited, std::pair<uint8_t, Rotations>,
+        phmap::priv::hash_default_hash<CubeMapVisited>, phmap::priv::hash_default_eq<CubeMapVisited>>;
+
+
+#pragma pack(push, 1)
+struct QuickNode {
+    Cube::Hash hash;
+    uint8_t depth;
+    float priority;
+
+    // sort priority_queue smaller to larger
+    bool operator<(const QuickNode& node) const {
+        return priority > node.priority;
+    }
+};
+#pragma pack(pop)
+
+
+// the quick search has its own small budget, once it is used up the exact search goes on alone
+class QuickBudget {
+public:
+    QuickBudget (const Setting& settings, SolveStop& solve_stop) :
+            solve_stop_(solve_stop),
+            max_positions_(settings.quick_positions),
+            has_deadline_(settings.quick_time_limit_ms > 0),
+            deadline_(std::chrono::steady_clock::now() + std::chrono::milliseconds(settings.quick_time_limit_ms)) {
+    }
+
+    // counts one expanded position, false once the budget is used up or the solve stops
+    bool Spend () {
+        if (num_positions_ >= max_positions_) {
+            return false;
+        }
+        if (++num_positions_ % kStopCheckInterval != 0) {
+            return true;
+        }
+        return !solve_stop_.StopRequested() && !(has_deadline_ && std::chrono::steady_clock::now() >= deadline_);
+    }
+
+    uint64_t NumPositions () const {
+        return num_positions_;
+    }
+
+private:
+    SolveStop& solve_stop_;
+    uint64_t max_positions_;
+    bool has_deadline_;
+    std::chrono::steady_clock::time_point deadline_;
+    uint64_t num_positions_ = 0;
+};
+
+
+// not admissible but guides the search well, the same sum the exact search sorts by
+int QuickHeuristic (Cube& cube) {
+    return cube.GetCornerHeuristic() + cube.GetEdgeHeuristic1() + cube.GetEdgeHeuristic2();
+}
+
+
+bool WeightedSearch (Setting& settings, Cube start_cube, QuickVisited& visited, Cube::Hash& goal, QuickBudget& budget) {
+    std::priority_queue<QuickNode> open;
+    open.push({start_cube.GetHash(), 0, 0});
+    visited[{start_cube.GetHash()}] = {0, Rotations(-1)};
+
+    while (!open.empty()) {
+        if (!budget.Spend()) {
+            return false;
+        }
+        QuickNode node = open.top();
+        open.pop();
+
+        // a shorter path to this position has been found
+        if (visited[{node.hash}].first < node.depth) {
+            continue;
+        }
+        if (TablebaseContainsOuter(node.hash)) {
+            goal = node.hash;
+            return true;
+        }
+        if (node.depth >= kMaxQuickDepth) {
+            continue;
+        }
+
+        Cube cube = DecodeHash(node.hash);
+        for (Rotations rotation : GetLegalRotations(cube)) {
+            Cube next_cube = Rotate(cube, rotation);
+            uint8_t next_depth = node.depth + 1;
+            auto [it, inserted] = visited.try_emplace({next_cube.GetHash()}, next_depth, rotation);
+            if (!inserted) {
+                if (it->second.first <= next_depth) {
+                    continue;
+                }
+                it->second = {next_depth, rotation};
+            }
+            open.push({next_cube.GetHash(), next_depth, float(next_depth + settings.weight * QuickHeuristic(next_cube))});
+        }
+    }
+    return false;
+}
+
+
+bool BeamSearch (Setting& settings, Cube start_cube, QuickVisited& visited, Cube::Hash& goal, QuickBudget& budget) {
+    std::vector<Cube::Hash> layer = {start_cube.GetHash()};
+    visited[{start_cube.GetHash()}] = {0, Rotations(-1)};
+
+    for (int depth = 0; !layer.empty() && depth < kMaxQuickDepth; depth++) {
+        // children with their heuristic
+        std::vector<std::pair<int, Cube::Hash>> candidates;
+        for (Cube::Hash hash : layer) {
+            if (!budget.Spend()) {
+                return false;
+            }
+            Cube cube = DecodeHash(hash);
+            for (Rotations rotation : GetLegalRotations(cube)) {
+                Cube next_cube = Rotate(cube, rotation);
+                Cube::Hash next_hash = next_cube.GetHash();
+                // positions of earlier depths or already in this one
+                if (!visited.try_emplace({next_hash}, uint8_t(depth+1), rotation).second) {
+                    continue;
+                }
+                if (TablebaseContainsOuter(next_hash)) {
+                    goal = next_hash;
+                    return true;
+                }
+                candidates.push_back({QuickHeuristic(next_cube), next_hash});
+            }
+        }
+
+        // keep the best beam_width positions
+        if (candidates.size() > size_t(settings.beam_width)) {
+            std::nth_element(candidates.begin(), candidates.begin() + settings.beam_width, candidates.end(),
+                             [](const std::pair<int, Cube::Hash>& a, const std::pair<int, Cube::Hash>& b) {return a.first < b.first;});
+            candidates.resize(settings.beam_width);
+        }
+        layer.clear();
+        for (const std::pair<int, Cube::Hash>& candidate : candidates) {
+            layer.push_back(candidate.second);
+        }
+    }
+    return false;
+}
+
+
+bool QuickSolve (ErrorHandler error_handler, Setting& settings, Cube start_cube, std::vector<Rotations>& path, SolveStop& solve_stop) {
+    QuickVisited visited;
+    Cube::Hash goal;
+    QuickBudget budget(settings, solve_stop);
+    bool found = settings.strategy == Setting::Strategy::kBeam ? BeamSearch(settings, start_cube, visited, goal, budget)
+                                                                : WeightedSearch(settings, start_cube, visited, goal, budget);
+    if (!found) {
+        error_handler.Handle(ErrorHandler::Level::kExtra, "quick_search.cpp", "quick search did not find a solution visiting " + std::to_string(budget.NumPositions()) + " positions");
+        return false;
+    }
+
+    // walk back to the start position
+    path.clear();
+    Cube cube = DecodeHash(goal);
+    for (Rotations rotation = visited[{cube.GetHash()}].second; rotation != Rotations(-1); rotation = visited[{cube.GetHash()}].second) {
+        path.push_back(rotation);
+        cube = Rotate(cube, CounterRotation(rotation));
+    }
+    std::reverse(path.begin(), path.end());
+
+    error_handler.Handle(ErrorHandler::Level::kExtra, "quick_search.cpp", "Found quick solution of depth " + std::to_string(path.size() + GetTablebaseDepth()) + " visiting " + std::to_string(budget.NumPositions()) + " positions");
+    return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cube.h"
+#include "error_handler.h"
+#include "rotation.h"
+#include "search.h"
+#include "settings.h"
+
+
+// weighted A* or beam search finding a short but not optimal solution fast
+// path gets the rotations from the start position to the outermost tablebase
+// it searches at most --quick_positions for --quick_time_limit_ms, the exact search keeps all of --positions
+bool QuickSolve (ErrorHandler error_handler, Setting& settings, Cube start_cube, std::vector<Rotations>& path, SolveStop& solve_stop);
@@ -1,5 +1,7 @@
+#include <array>
 #include <cstdint>
 #include <random>
+#include <string>
 #include <vector>
 
 #include "actions.h"
@@ -29,6 +31,39 @@ std::vector<Rotations> GetLegalRotations (Cube& cube) {
 }
 
 
+// rotation undoing the given rotation
+Rotations CounterRotation (Rotations rotation) {
+    if (rotation%2==0) {
+        return Rotations(int(rotation)+1);
+    }
+    return Rotations(int(rotation)-1);
+}
+
+
+constexpr std::array<const char*, kNumRotations> kRotationNames = {
+    "R", "R'", "L", "L'",
+    "U", "U'", "D", "D'",
+    "F", "F'", "B", "B'",
+    "M", "M'", "E", "E'", "S", "S'"
+};
+
+
+std::string RotationName (Rotations rotation) {
+    return kRotationNames[rotation];
+}
+
+
+bool ParseRotation (const std::string& name, Rotations& rotation) {
+    for (int i = 0; i < kNumRotations; i++) {
+        if (name == kRotationNames[i]) {
+            rotation = Rotations(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+
 // get a random legal rotation
 Rotations GetRandomRotation (Cube& cube, std::mt19937& rng) {
     std::vector<Rotations> legal_rotation = GetLegalRotations(cube);
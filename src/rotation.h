@@ -2,6 +2,7 @@
 
 #include <random>
 #include <cstdint>
+#include <string>
 
 #include "actions.h"
 #include "cube.h"
@@ -34,6 +35,17 @@ enum Rotations : uint8_t {
 std::vector<Rotations> GetLegalRotations (Cube& cube);
 
 
+// rotation undoing the given rotation
+Rotations CounterRotation (Rotations rotation);
+
+
+// standard notation of a rotation, e.g. R or R'
+std::string RotationName (Rotations rotation);
+
+// returns false if name is no rotation
+bool ParseRotation (const std::string& name, Rotations& rotation);
+
+
 // rotation of the cube (not visual)
 Cube Rotate (const Cube& cube, Rotations rotation);
 
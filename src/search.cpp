@@ -1,91 +1,118 @@
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <random>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <utility>
 #include <vector>
-#include <parallel_hashmap/phmap.h>
 #include <nadeau.h>
-#include <concurrentqueue.h>
 
 
 #include "actions.h"
+#include "bidirectional_search.h"
+#include "checkpoint.h"
 #include "cube.h"
 #include "error_handler.h"
-#include "parallel_hashmap/phmap_fwd_decl.h"
+#include "ida_search.h"
+#include "open_list.h"
+#include "quick_search.h"
 #include "rotation.h"
 #include "settings.h"
 #include "tablebase.h"
+#include "thread_pool.h"
+#include "visited.h"
 
 
-#pragma pack(push, 1)
-struct CubeMapVisited {
-    // memory optimized representation of the cube
-    Cube::Hash hash;
-
-    bool operator==(const CubeMapVisited& position) const {
-        return hash.hash_1 == position.hash.hash_1 && hash.hash_2 == position.hash.hash_2;
-    }
-
-    friend size_t hash_value(const CubeMapVisited& position) { // NOLINT
-        return phmap::HashState::combine(0, position.hash.hash_1, position.hash.hash_2);
-    }
-};
-#pragma pack(pop)
+CubeSearch GetCubeSearch (Cube& cube, uint8_t depth, uint8_t visited_time) {
+    CubeSearch cube_search;
+    cube_search.hash = cube.GetHash();
+    #ifdef PACKED_QUEUE
+    cube_search.packed = cube.GetPacked();
+    #endif
+    cube_search.heuristic = cube.GetCornerHeuristic() + cube.GetEdgeHeuristic1() + cube.GetEdgeHeuristic2() + depth + visited_time;
+    cube_search.depth = depth;
+    cube_search.visited_time = visited_time;
+    cube_search.SetPendingRotations(0);
+    return cube_search;
+}
 
 
-#pragma pack(push, 1)
-struct CubeSearch {
-    // memory optimized representation of the cube
-    Cube::Hash hash;
+// lower bound of the solution depth through the position
+int BoundKey (Cube& cube, int depth) {
+    return depth + std::max(std::max({cube.GetCornerHeuristic(), int(cube.GetEdgeHeuristic1()), int(cube.GetEdgeHeuristic2())}) - GetTablebaseDepth(), 0);
+}
 
-    uint8_t heuristic;
-    uint8_t depth;
 
-    // this is a value from 0 to 4 describing how often this position is been visited
-    uint8_t visited_time;
+// small direct mapped cache of positions this thread has recently seen
+// a cached depth is a depth the position was already reached with, so a path that is not shorter can be skipped
+// the visited table may have replaced or removed the entry since, then a stale depth only skips a duplicate path
+// it is scratch memory of a worker, so every search resets it
+class RecentFilter {
+public:
+    // empties the 2^bits entries, the memory is reused if the size did not change
+    void Reset (int bits) {
+        shift_ = 64 - bits;
+        entries_.assign(bits == 0 ? 0 : size_t(1) << bits, Entry());
+    }
 
-    // sort priority_queue smaller to larger
-    bool operator<(const CubeSearch& cube_search) const {
-        if (heuristic != cube_search.heuristic) {
-            return heuristic > cube_search.heuristic;
+    // the position has been seen with at most this depth or kNotVisited
+    int Depth (Cube::Hash hash) const {
+        if (entries_.empty()) {
+            return Visited::kNotVisited;
         }
-        if (hash.hash_1 != cube_search.hash.hash_1) {
-            return hash.hash_1 > cube_search.hash.hash_1;
+        const Entry& entry = entries_[Index(hash)];
+        if (entry.depth == kEmpty || entry.hash.hash_1 != hash.hash_1 || entry.hash.hash_2 != hash.hash_2) {
+            return Visited::kNotVisited;
         }
-        return hash.hash_2 > cube_search.hash.hash_2;
+        return entry.depth;
     }
-};
-#pragma pack(pop)
 
+    void Insert (Cube::Hash hash, int depth) {
+        if (entries_.empty()) {
+            return;
+        }
+        entries_[Index(hash)] = {hash, uint8_t(depth)};
+    }
 
-CubeSearch GetCubeSearch (Cube& cube, uint8_t depth, uint8_t visited_time) {
-    CubeSearch cube_search;
-    cube_search.hash = cube.GetHash();
-    cube_search.heuristic = cube.GetCornerHeuristic() + cube.GetEdgeHeuristic1() + cube.GetEdgeHeuristic2() + depth + visited_time;
-    cube_search.depth = depth;
-    cube_search.visited_time = visited_time;
-    return cube_search;
-}
+private:
+    static constexpr uint8_t kEmpty = 255;
 
+    #pragma pack(push, 1)
+    struct Entry {
+        Cube::Hash hash;
+        uint8_t depth = kEmpty;
+    };
+    #pragma pack(pop)
 
-using VisitedMap = phmap::parallel_flat_hash_map<CubeMapVisited, std::pair<uint8_t, Rotations>,
-            phmap::priv::hash_default_hash<CubeMapVisited>, phmap::priv::hash_default_eq<CubeMapVisited>,
-            phmap::priv::Allocator<std::pair<CubeMapVisited, std::pair<uint8_t, Rotations>>>,
-            12, std::mutex>;
+    size_t Index (Cube::Hash hash) const {
+        return ((hash.hash_1 ^ hash.hash_2) * 0x9E3779B97F4A7C15) >> shift_; // NOLINT
+    }
 
-using SearchQueue = std::vector<moodycamel::ConcurrentQueue<CubeSearch>>;
+    int shift_ = 64;
+    std::vector<Entry> entries_;
+};
 
 
-void ShowMemory (ErrorHandler error_handler, VisitedMap& visited) {
+void ShowMemory (ErrorHandler error_handler, Visited& visited) {
+    // counting the entries of a fixed size table is not free
+    if (error_handler.error_level < ErrorHandler::Level::kMemory) {
+        return;
+    }
+    size_t entry_bytes = visited.EntryBytes();
+    size_t size = visited.Size();
+    size_t capacity = visited.Capacity();
     std::stringstream out;
     out << "\n";
-    out << std::setw(Setting::kIndent) << "" << "Map: " << 11 * visited.size() << " = 11 * " << visited.size() << " = " << 11 * visited.size() / 1000000 << " MB" << std::endl; // NOLINT
-    out << std::setw(Setting::kIndent) << "" << "Map capacity: " << 11 * visited.capacity() << " = 11 * " << visited.capacity() << " = " << 11 * visited.capacity() / 1000000 << " MB" << std::endl; // NOLINT
+    out << std::setw(Setting::kIndent) << "" << "Map: " << entry_bytes * size << " = " << entry_bytes << " * " << size << " = " << entry_bytes * size / 1000000 << " MB" << std::endl; // NOLINT
+    out << std::setw(Setting::kIndent) << "" << "Map capacity: " << entry_bytes * capacity << " = " << entry_bytes << " * " << capacity << " = " << entry_bytes * capacity / 1000000 << " MB" << std::endl; // NOLINT
     out << std::setw(Setting::kIndent) << "" << "current: " << getCurrentRSS() << " = " << getCurrentRSS() / 1000000 << " MB" << std::endl; // NOLINT
     out << std::setw(Setting::kIndent) << "" << "peak: " << getPeakRSS() << " = " << getPeakRSS() / 1000000 << " MB"; // NOLINT
     error_handler.Handle(ErrorHandler::Level::kMemory, "search.cpp", out.str());
@@ -93,43 +120,180 @@ void ShowMemory (ErrorHandler error_handler, VisitedMap& visited) {
 
 
 constexpr int kNotFoundSol = 1e9;
-constexpr int kNumSearchQueues = 150;
+constexpr uint64_t kGenerationPositions = 1 << 16;
+constexpr uint8_t kMaxVisitedTime = 4;
+constexpr uint32_t kAllRotations = (1 << kNumRotations) - 1;
+constexpr std::chrono::milliseconds kSweepInterval(10);
+
 
+SolveStop::SolveStop (Setting& settings, Actions& actions) :
+        actions_(actions),
+        has_deadline_(settings.time_limit_ms > 0),
+        deadline_(std::chrono::steady_clock::now() + std::chrono::milliseconds(settings.time_limit_ms)) {
+}
+
+
+bool SolveStop::StopRequested () {
+    if (actions_.stop || actions_.cancel || deadline_reached_) {
+        return true;
+    }
+    if (has_deadline_ && std::chrono::steady_clock::now() >= deadline_) {
+        deadline_reached_ = true;
+        return true;
+    }
+    return false;
+}
 
-void Search (ErrorHandler error_handler, Setting& settings, VisitedMap& visited, SearchQueue& search_queue,
-             std::atomic<int>& max_depth, std::mutex& max_depth_mutex, CubeSearch& tablebase_cube,
-             std::atomic<uint64_t>& num_positions, std::atomic<uint64_t>& search_queue_size, std::atomic<bool>& optimal) {
+
+// follow the depth labels from cube back to the start position
+// every step goes to a neighbour reached earlier, so the path is at most as long as the depth of cube
+bool WalkBackDepths (Visited& visited, Cube cube, int depth, std::vector<Rotations>& path) {
+    while (depth > 0) {
+        int best_depth = depth;
+        Rotations best_rotation = Rotations(-1);
+        Cube best_cube;
+        for (Rotations rotation : GetLegalRotations(cube)) {
+            Cube parent = Rotate(cube, rotation);
+            int parent_depth = visited.Depth(parent.GetHash());
+            if (parent_depth >= best_depth) {
+                continue;
+            }
+            // the rotation back to cube has to be legal at the parent as well
+            std::vector<Rotations> parent_rotations = GetLegalRotations(parent);
+            if (std::find(parent_rotations.begin(), parent_rotations.end(), CounterRotation(rotation)) == parent_rotations.end()) {
+                continue;
+            }
+            best_depth = parent_depth;
+            best_rotation = rotation;
+            best_cube = parent;
+        }
+        // the labels do not lead back to the start position
+        if (best_rotation == Rotations(-1)) {
+            return false;
+        }
+        path.push_back(CounterRotation(best_rotation));
+
+        cube = best_cube;
+        depth = best_depth;
+    }
+    return true;
+}
+
+
+// follow the rotations stored in visited from cube back to the start position
+// returns false if an entry of the path got replaced
+bool WalkBack (Visited& visited, Cube cube, int depth, std::vector<Rotations>& path) {
+    path.clear();
+    if (!visited.StoresRotations()) {
+        int cube_depth = visited.Depth(cube.GetHash());
+        return cube_depth <= depth && WalkBackDepths(visited, cube, cube_depth, path);
+    }
+    while (true) {
+        uint8_t visited_depth;
+        Rotations rotation;
+        if (!visited.Find(cube.GetHash(), visited_depth, rotation) || visited_depth > depth) {
+            return false;
+        }
+        if (rotation == Rotations(-1)) {
+            return true;
+        }
+        path.push_back(rotation);
+
+        cube = Rotate(cube, CounterRotation(rotation));
+        depth = visited_depth - 1;
+    }
+}
+
+
+// removes visited positions that cannot lead to a solution shorter than max_depth anymore
+// the path of the best solution got walked back before max_depth was lowered, so it is not needed
+void SweepVisited (ErrorHandler error_handler, Visited& visited, std::atomic<int>& max_depth, std::atomic<bool>& search_done) {
+    int swept_bound = kNotFoundSol;
+    while (!search_done) {
+        int bound = max_depth;
+        if (bound >= swept_bound) {
+            std::this_thread::sleep_for(kSweepInterval);
+            continue;
+        }
+
+        size_t num_removed = 0;
+        for (size_t chunk = 0; chunk < visited.NumChunks() && !search_done; chunk++) {
+            num_removed += visited.SweepChunk(chunk, [bound](Cube::Hash hash, uint8_t depth) {
+                if (depth >= bound) {
+                    return true;
+                }
+                Cube cube = DecodeHash(hash);
+                return BoundKey(cube, depth) >= bound;
+            });
+        }
+        swept_bound = bound;
+        error_handler.Handle(ErrorHandler::Level::kExtra, "search.cpp", "garbage collection removed " + std::to_string(num_removed) + " visited positions = " + std::to_string(num_removed * visited.EntryBytes()) + " bytes");
+    }
+}
+
+
+// writes the search to the checkpoint file every checkpoint_interval_s seconds
+void CheckpointSearch (ErrorHandler error_handler, Setting& settings, Cube::Hash start_hash, Visited& visited, OpenList& open_list,
+                       std::atomic<int>& max_depth, std::mutex& max_depth_mutex, Incumbent& incumbent,
+                       std::atomic<uint64_t>& num_positions, std::atomic<bool>& search_done) {
+    auto next_checkpoint = std::chrono::steady_clock::now() + std::chrono::seconds(settings.checkpoint_interval_s);
+    while (!search_done) {
+        if (std::chrono::steady_clock::now() < next_checkpoint) {
+            std::this_thread::sleep_for(kSweepInterval);
+            continue;
+        }
+        WriteCheckpoint(error_handler, settings.checkpoint, start_hash, visited, open_list, [&]() {
+            std::lock_guard<std::mutex> guard(max_depth_mutex);
+            return SearchProgress{num_positions, max_depth, incumbent};
+        });
+        next_checkpoint = std::chrono::steady_clock::now() + std::chrono::seconds(settings.checkpoint_interval_s);
+    }
+}
+
+
+void Search (ErrorHandler error_handler, Setting& settings, Visited& visited, OpenList& open_list,
+             std::atomic<int>& max_depth, std::mutex& max_depth_mutex, Incumbent& incumbent,
+             std::atomic<uint64_t>& num_positions, std::atomic<bool>& optimal, SolveStop& solve_stop) {
+    // answers most duplicate checks without touching the shared visited positions
+    RecentFilter& recent = WorkerScratch<RecentFilter>();
+    recent.Reset(settings.recent_filter_bits);
+
+    uint64_t num_checks = 0;
     while (num_positions < settings.max_num_positions) {
         // stop if it found a solution of a specific depth
         if (max_depth + GetTablebaseDepth() <= settings.min_depth) {
-            return;
+            break;
         }
 
-        // get new position from priority_queue
-        CubeSearch cube_search;
-        bool found = false;
-        for (moodycamel::ConcurrentQueue<CubeSearch>& queue : search_queue) {
-            if(!queue.try_dequeue(cube_search)) {
-                continue;
-            }
-            found = true;
+        // cancelled or out of time
+        if (++num_checks % kStopCheckInterval == 0 && solve_stop.StopRequested()) {
             break;
         }
-        if (!found) {
+
+        // get new position from priority_queue, sleeps while other workers are still expanding
+        CubeSearch cube_search;
+        if (!open_list.Pop(cube_search)) {
             // has searched through all positions
-            if (search_queue_size == 0) {
+            if (open_list.Drained()) {
                 optimal = true;
-                return;
             }
-            continue;
+            return;
         }
 
-        ++num_positions;
+        // entries written from now on are younger
+        if (++num_positions % kGenerationPositions == 0) {
+            visited.NextGeneration();
+        }
+        #ifdef PACKED_QUEUE
+        Cube cube = UnpackCube(cube_search.packed, cube_search.hash);
+        #else
         Cube cube = DecodeHash(cube_search.hash);
+        #endif
 
         // check if it is posible to solve the current cube im this amount of moves
-        if (cube_search.depth + (std::max(std::max({cube.GetCornerHeuristic(), int(cube.GetEdgeHeuristic1()), int(cube.GetEdgeHeuristic2())}) - GetTablebaseDepth(), 0)) >= max_depth) {
-            --search_queue_size;
+        int bound_key = BoundKey(cube, cube_search.depth);
+        if (bound_key >= max_depth) {
+            open_list.Done();
             continue;
         }
 
@@ -139,135 +303,350 @@ void Search (ErrorHandler error_handler, Setting& settings, VisitedMap& visited,
             std::lock_guard<std::mutex> guard(max_depth_mutex);
             // improved depth
             if (cube_search.depth < max_depth) {
+                // before the garbage collection may remove the path for the lower bound
+                incumbent.path_known = WalkBack(visited, cube, cube_search.depth, incumbent.path);
+                incumbent.tablebase_cube = cube_search;
                 max_depth = cube_search.depth;
-                tablebase_cube = cube_search;
                 ShowMemory(error_handler, visited);
                 error_handler.Handle(ErrorHandler::Level::kExtra, "search.cpp", "Found solution of depth " + std::to_string(cube_search.depth + GetTablebaseDepth()) + " visiting " + std::to_string(num_positions) + " positions");
+                // queued positions that cannot lead to a shorter solution
+                uint64_t num_dropped = open_list.Prune(max_depth);
+                error_handler.Handle(ErrorHandler::Level::kExtra, "search.cpp", "dropped " + std::to_string(num_dropped) + " queued positions");
             }
         }
 
         // searched a branch to depth 100
         if (cube_search.depth >= 100) {
-            --search_queue_size;
+            open_list.Done();
             continue;
         }
 
         Cube::Hash cube_hash = cube.GetHash();
         // check if position has already been searched
-        bool already_visited = false;
-        auto already_visited_lamda = [&already_visited, cube_search](const VisitedMap::value_type& value) {already_visited = value.second.first < cube_search.depth;};
-        visited.if_contains({cube_hash}, already_visited_lamda);
-        if (already_visited) {
-            --search_queue_size;
+        if (recent.Depth(cube_hash) < cube_search.depth || visited.Depth(cube_hash) < cube_search.depth) {
+            open_list.Done();
             continue;
         }
+        // the inverse rotations of the children lead back to this position
+        recent.Insert(cube_hash, cube_search.depth);
+
+        // partial expansion generates only the children not admitted by an earlier visit
+        // and requeues the position directly at the next f value of them
+        uint32_t pending = cube_search.visited_time == 0 ? kAllRotations : cube_search.PendingRotations();
+        uint32_t next_pending = 0;
+        int base_heuristic = cube_search.heuristic - cube_search.visited_time;
+        int next_heuristic = base_heuristic + kMaxVisitedTime + 1;
 
         // go over next moves
         for (Rotations rotation : GetLegalRotations(cube)) {
+            if (settings.partial_expansion && (pending >> rotation & 1) == 0) {
+                continue;
+            }
             Cube next_cube = Rotate(cube, rotation);
 
             Cube::Hash next_cube_hash = next_cube.GetHash();
 
             // too high depth to be usefull
-            if (cube_search.depth+1 + (std::max(std::max({next_cube.GetCornerHeuristic(), int(next_cube.GetEdgeHeuristic1()), int(next_cube.GetEdgeHeuristic2())}) - GetTablebaseDepth(), 0)) >= max_depth) {
+            int next_bound_key = BoundKey(next_cube, cube_search.depth+1);
+            if (next_bound_key >= max_depth) {
                 continue;
             }
 
             // has already been visited
-            bool already_visited = false;
-            auto already_visited_lamda = [&already_visited, cube_search](const VisitedMap::value_type& value) {already_visited = value.second.first <= cube_search.depth+1;};
-            visited.if_contains({next_cube_hash}, already_visited_lamda);
-            if (already_visited) {
+            if (recent.Depth(next_cube_hash) <= cube_search.depth+1) {
+                continue;
+            }
+            int visited_depth = visited.Depth(next_cube_hash);
+            if (visited_depth <= cube_search.depth+1) {
+                recent.Insert(next_cube_hash, visited_depth);
                 continue;
             }
 
             // add to search if the next cube is visited_times better than current cube
             CubeSearch next = GetCubeSearch(next_cube, cube_search.depth+1, 0);
             if (cube_search.visited_time==0 ? (next.heuristic <= cube_search.heuristic) : (next.heuristic == cube_search.heuristic)) {
-                search_queue[next.heuristic].enqueue(next);
-                visited.try_emplace_l({next_cube_hash},
-                                      [cube_search, rotation](VisitedMap::value_type& value){
-                                        if (cube_search.depth+1 < value.second.first) {
-                                            value.second = {cube_search.depth+1, rotation};
-                                        }
-                                      }, std::make_pair(cube_search.depth+1, rotation));
-                ++search_queue_size;
+                // another thread was faster or the table is full
+                if (!visited.Update(next_cube_hash, cube_search.depth+1, rotation)) {
+                    continue;
+                }
+                recent.Insert(next_cube_hash, cube_search.depth+1);
+                open_list.Push(next, next_bound_key);
+            }
+            // admitted by a later visit
+            else if (next.heuristic <= base_heuristic + kMaxVisitedTime) {
+                next_pending |= 1 << rotation;
+                next_heuristic = std::min(next_heuristic, int(next.heuristic));
             }
         }
 
-        if (cube_search.visited_time < 4) {
+        if (settings.partial_expansion) {
+            if (next_pending != 0) {
+                CubeSearch temp_cube_search = cube_search;
+                temp_cube_search.heuristic = next_heuristic;
+                temp_cube_search.visited_time = next_heuristic - base_heuristic;
+                temp_cube_search.SetPendingRotations(next_pending);
+                open_list.Push(temp_cube_search, bound_key);
+            }
+        }
+        else if (cube_search.visited_time < kMaxVisitedTime) {
             CubeSearch temp_cube_search = GetCubeSearch(cube, cube_search.depth, cube_search.visited_time+1);
-            search_queue[temp_cube_search.heuristic].enqueue(temp_cube_search);
-            ++search_queue_size;
+            open_list.Push(temp_cube_search, bound_key);
         }
-        --search_queue_size;
+        open_list.Done();
     }
+    // the other workers must not wait for positions of this one
+    open_list.Close();
 }
 
 
-bool Solve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions) {
+// time decoding queue entries with and without the packed pieces
+void QueueBenchmark (ErrorHandler error_handler, Setting& settings, std::mt19937& rng) {
+    const uint64_t max_benchmark_positions = 1000000;
+    uint64_t num_benchmark_positions = std::max(std::min(settings.max_num_positions, max_benchmark_positions), uint64_t(1));
+
+    // positions of a random walk
+    std::vector<Cube::Hash> hashes;
+    std::vector<Cube::Packed> packed;
+    Cube cube;
+    for (uint64_t i = 0; i < num_benchmark_positions; i++) {
+        std::vector<Rotations> legal_rotations = GetLegalRotations(cube);
+        std::uniform_int_distribution<size_t> distribution(0, legal_rotations.size()-1);
+        cube = Rotate(cube, legal_rotations[distribution(rng)]);
+        hashes.push_back(cube.GetHash());
+        packed.push_back(cube.GetPacked());
+    }
+
+    // the checksum keeps the compiler from skipping the decoding
+    // (the hash does not store the orientation of the last corner, it is never used)
+    uint64_t checksum = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    for (Cube::Hash hash : hashes) {
+        Cube decoded = DecodeHash(hash);
+        checksum += decoded.edges[Cube::kNumEdges-1].position + decoded.corners[0].orientation;
+    }
+    auto hash_time = std::chrono::steady_clock::now() - start_time;
+
+    start_time = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < num_benchmark_positions; i++) {
+        Cube decoded = UnpackCube(packed[i], hashes[i]);
+        checksum -= decoded.edges[Cube::kNumEdges-1].position + decoded.corners[0].orientation;
+    }
+    auto packed_time = std::chrono::steady_clock::now() - start_time;
+
+    #ifdef PACKED_QUEUE
+    size_t packed_entry_bytes = sizeof(CubeSearch);
+    bool packed_queue = true;
+    #else
+    size_t packed_entry_bytes = sizeof(CubeSearch) + sizeof(Cube::Packed);
+    bool packed_queue = false;
+    #endif
+    size_t hash_entry_bytes = packed_entry_bytes - sizeof(Cube::Packed);
+
+    std::stringstream out;
+    out << "queue benchmark of " << num_benchmark_positions << " positions" << (checksum == 0 ? "" : " (decoded positions differ)") << std::endl;
+    out << std::setw(Setting::kIndent) << "" << "hash:   " << std::chrono::duration<double, std::nano>(hash_time).count() / num_benchmark_positions << " ns per position, "
+        << hash_entry_bytes << " bytes per entry, " << hash_entry_bytes * settings.max_num_positions / 1000000 << " MB for " << settings.max_num_positions << " positions" << std::endl; // NOLINT
+    out << std::setw(Setting::kIndent) << "" << "packed: " << std::chrono::duration<double, std::nano>(packed_time).count() / num_benchmark_positions << " ns per position, "
+        << packed_entry_bytes << " bytes per entry, " << packed_entry_bytes * settings.max_num_positions / 1000000 << " MB for " << settings.max_num_positions << " positions" << std::endl; // NOLINT
+    out << std::setw(Setting::kIndent) << "" << "this build uses " << (packed_queue ? "packed" : "hash") << " entries, change it with cmake -DPACKED_QUEUE=" << (packed_queue ? "OFF" : "ON");
+    error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", out.str());
+}
+
+
+// find a path from cube to target with at most max_depth rotations
+// |h(cube) - h(target)| of every pattern database is a lower bound of the distance between them
+bool PathSearch (Visited& visited, Cube& cube, Cube& target, int depth, int max_depth, Rotations last_rotation, Actions& actions, uint64_t& num_positions) {
+    num_positions++;
+    Cube::Hash hash = cube.GetHash();
+    Cube::Hash target_hash = target.GetHash();
+    if (hash.hash_1 == target_hash.hash_1 && hash.hash_2 == target_hash.hash_2) {
+        return true;
+    }
+
+    int distance = std::max({std::abs(cube.GetCornerHeuristic() - target.GetCornerHeuristic()),
+                             std::abs(int(cube.GetEdgeHeuristic1()) - int(target.GetEdgeHeuristic1())),
+                             std::abs(int(cube.GetEdgeHeuristic2()) - int(target.GetEdgeHeuristic2()))});
+    if (depth + distance > max_depth) {
+        return false;
+    }
+
+    // a shorter path to this position is known
+    if (visited.Depth(hash) < depth) {
+        return false;
+    }
+
+    // dfs
+    for (Rotations rotation : GetLegalRotations(cube)) {
+        if (last_rotation != Rotations(-1) && rotation == CounterRotation(last_rotation)) {
+            continue;
+        }
+        Cube next_cube = Rotate(cube, rotation);
+        if (PathSearch(visited, next_cube, target, depth+1, max_depth, rotation, actions, num_positions)) {
+            actions.solve.push(rotation);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// threads of the next solve of a batch
+// the unfinished solves share all threads, so the last runs of a batch get more of them
+int ThreadsPerSolve (const Setting& settings, Cube& cube, int num_unfinished) {
+    // the pattern databases see the position closer to solved than the tablebase depth
+    // sharing the positions of such an easy search costs more than it saves
+    int lower_bound = std::max({int(cube.GetCornerHeuristic()), int(cube.GetEdgeHeuristic1()), int(cube.GetEdgeHeuristic2())});
+    if (lower_bound < settings.tablebase_depth) {
+        return 1;
+    }
+    int num_solves = std::clamp(num_unfinished, 1, settings.concurrent_solves);
+    return std::max(settings.num_threads / num_solves, 1);
+}
+
+
+bool Solve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions, std::unique_ptr<SearchState>& state) {
     int tb_depth = TablebaseDepth(start_cube);
+    actions.solve_optimal = tb_depth != -1;
     if (tb_depth != -1) {
         TablebaseSolve(start_cube, actions, tb_depth+1, num_positions);
         return true;
     }
 
+    SolveStop solve_stop(settings, actions);
 
-    // initialize starting position
-    CubeSearch tablebase_cube;
-    SearchQueue search_queue(kNumSearchQueues);
-    CubeSearch start_cube_search = GetCubeSearch(start_cube, 0, 0);
-    search_queue[start_cube_search.heuristic].enqueue(start_cube_search);
-    std::atomic<uint64_t> search_queue_size = 1;
+    if (settings.algorithm == Setting::Algorithm::kIda) {
+        return IdaSolve(error_handler, settings, actions, start_cube, num_positions, solve_stop);
+    }
+    if (settings.algorithm == Setting::Algorithm::kBidirectional) {
+        return BidirectionalSolve(error_handler, settings, actions, start_cube, num_positions, solve_stop);
+    }
 
-    VisitedMap visited;
-    visited.insert({{start_cube.GetHash()}, {0, Rotations(-1)}});
+
+    // a quick solution bounds the exact search, the quick search does not spend its positions
+    std::vector<Rotations> quick_path;
+    bool has_quick_path = settings.strategy != Setting::Strategy::kExact && QuickSolve(error_handler, settings, start_cube, quick_path, solve_stop);
+
+    // initialize starting position
+    Incumbent incumbent;
+    if (!state) {
+        state = std::make_unique<SearchState>(settings);
+    }
+    state->Reset(GetThreadPool(settings));
+    Visited& visited = state->visited;
+    visited.Update(start_cube.GetHash(), 0, Rotations(-1));
 
     // best found depth
     std::atomic<int> max_depth = kNotFoundSol;
     std::mutex max_depth_mutex;
+    if (has_quick_path) {
+        Cube quick_cube = start_cube;
+        for (Rotations rotation : quick_path) {
+            quick_cube = Rotate(quick_cube, rotation);
+        }
+        max_depth = quick_path.size();
+        incumbent.tablebase_cube = GetCubeSearch(quick_cube, quick_path.size(), 0);
+        incumbent.path.assign(quick_path.rbegin(), quick_path.rend());
+        incumbent.path_known = true;
+    }
+    OpenList& open_list = state->open_list;
+    open_list.Prune(max_depth);
+
+    // continue the search written to a checkpoint
+    ResumeResult resumed = ResumeResult::kNotFound;
+    if (!settings.resume.empty()) {
+        SearchProgress progress;
+        resumed = ReadCheckpoint(error_handler, settings.resume, start_cube.GetHash(), visited, open_list, progress);
+        if (resumed == ResumeResult::kDamaged) {
+            return false;
+        }
+        if (resumed == ResumeResult::kResumed) {
+            num_positions += progress.num_positions;
+            // the quick solution may be better
+            if (progress.max_depth < max_depth) {
+                max_depth = progress.max_depth;
+                incumbent = progress.incumbent;
+                open_list.Prune(max_depth);
+            }
+        }
+    }
+    if (resumed != ResumeResult::kResumed) {
+        open_list.Push(GetCubeSearch(start_cube, 0, 0), BoundKey(start_cube, 0));
+    }
     std::atomic<uint64_t> num_positions_atomic = num_positions;
 
     std::atomic<bool> optimal = false;
+
+    // garbage collection of the visited positions
+    std::atomic<bool> search_done = false;
+    std::jthread sweeper;
+    if (settings.visited_gc) {
+        sweeper = std::jthread(SweepVisited, error_handler, std::ref(visited), std::ref(max_depth), std::ref(search_done));
+    }
+    std::jthread checkpointer;
+    if (!settings.checkpoint.empty()) {
+        checkpointer = std::jthread(CheckpointSearch, error_handler, std::ref(settings), start_cube.GetHash(), std::ref(visited), std::ref(open_list),
+                                    std::ref(max_depth), std::ref(max_depth_mutex), std::ref(incumbent), std::ref(num_positions_atomic), std::ref(search_done));
+    }
     
-    // start multiple threads
-    {
-        std::vector<std::jthread> threads;
-        for (int i = 0; i < settings.num_threads; i++) {
-            threads.push_back(std::jthread(Search, error_handler, std::ref(settings), std::ref(visited), std::ref(search_queue), std::ref(max_depth),
-                    std::ref(max_depth_mutex), std::ref(tablebase_cube), std::ref(num_positions_atomic), std::ref(search_queue_size), std::ref(optimal)));
-        }
+    // search with the workers of the thread pool
+    GetThreadPool(settings).Run(settings.num_threads, [&]([[maybe_unused]] int worker) {
+        Search(error_handler, settings, visited, open_list, max_depth, max_depth_mutex, incumbent, num_positions_atomic, optimal, solve_stop);
+    });
+    search_done = true;
+    if (sweeper.joinable()) {
+        sweeper.join();
+    }
+    if (checkpointer.joinable()) {
+        checkpointer.join();
     }
     num_positions = num_positions_atomic;
 
+    // the search stopped early, so it can be continued from here
+    if (!settings.checkpoint.empty() && !open_list.Drained()) {
+        WriteCheckpoint(error_handler, settings.checkpoint, start_cube.GetHash(), visited, open_list, [&]() {
+            return SearchProgress{num_positions, max_depth, incumbent};
+        });
+    }
+
+    if (solve_stop.DeadlineReached()) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", "time limit reached after " + std::to_string(num_positions) + " positions");
+    }
     ShowMemory(error_handler, visited);
+    // positions that did not fit into the table were never searched
+    if (visited.Overflowed()) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "search.cpp", "visited table is full, increase --visited_memory");
+        optimal = false;
+    }
+    // lost positions of a run file were never searched
+    if (open_list.SpillFailed()) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "search.cpp", "could not use the run files in --spill_dir=" + settings.spill_dir);
+        optimal = false;
+    }
     if (optimal) {
         error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", "found optimal solution");
     }
+    actions.solve_optimal = optimal;
     if (max_depth == kNotFoundSol) {
         error_handler.Handle(ErrorHandler::Level::kWarning, "search.cpp", "Did not find a solution within " + std::to_string(num_positions) + " positions");
         return false;
     }
 
 
-    Cube cube = DecodeHash(tablebase_cube.hash);
+    Cube cube = DecodeHash(incumbent.tablebase_cube.hash);
     TablebaseSolve(cube, actions, TablebaseDepth(cube)+1, num_positions);
 
-    while (true) {
-        Rotations rotation = visited[{cube.GetHash()}].second;
-        if (rotation == Rotations(-1)) {
-            return true;
+    // the entry got replaced so the path has to be searched again
+    int depth = incumbent.tablebase_cube.depth;
+    if (!incumbent.path_known && !WalkBack(visited, cube, depth, incumbent.path)) {
+        error_handler.Handle(ErrorHandler::Level::kExtra, "search.cpp", "search the first " + std::to_string(depth) + " rotations of the path again");
+        if (!PathSearch(visited, start_cube, cube, 0, depth, Rotations(-1), actions, num_positions)) {
+            error_handler.Handle(ErrorHandler::Level::kError, "search.cpp", "could not find the path to the solution");
+            return false;
         }
+        return true;
+    }
+    for (Rotations rotation : incumbent.path) {
         actions.solve.push(rotation);
-
-        Rotations counter_rotation;
-        if (rotation%2==0) {
-            counter_rotation = Rotations(int(rotation)+1);
-        }
-        else {
-            counter_rotation = Rotations(int(rotation)-1);
-        }
-
-        cube = Rotate(cube, counter_rotation);
     }
+    return true;
 }
@@ -1,6 +1,69 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+
 #include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "open_list.h"
+#include "settings.h"
+#include "thread_pool.h"
+#include "visited.h"
+
+
+// cooperative cancellation of a solve
+// the workers check it after every batch of positions and the best solution so far is kept
+class SolveStop {
+public:
+    SolveStop (Setting& settings, Actions& actions);
+
+    // the solve got cancelled, the program is stopping or the time limit is reached
+    bool StopRequested ();
+
+    bool DeadlineReached () const {
+        return deadline_reached_;
+    }
+
+private:
+    Actions& actions_;
+    bool has_deadline_;
+    std::chrono::steady_clock::time_point deadline_;
+    std::atomic<bool> deadline_reached_ = false;
+};
+
+
+// positions searched between two checks of the stop conditions
+constexpr uint64_t kStopCheckInterval = 256;
+
+
+// visited positions and open list of the astar search
+// they are reset in place by every solve, so their memory stays allocated between the runs
+struct SearchState {
+    SearchState (const Setting& settings) : visited(settings), open_list(settings) {}
+
+    void Reset (ThreadPool& pool) {
+        visited.Reset(pool);
+        open_list.Reset();
+    }
+
+    Visited visited;
+    OpenList open_list;
+};
+
+
+// threads of the next solve of a batch
+// the unfinished solves share all threads, so the last runs of a batch get more of them
+int ThreadsPerSolve (const Setting& settings, Cube& cube, int num_unfinished);
+
+
+// a set actions.cancel stops the solve, the caller resets it before the next solve
+// the search state is created by the first astar solve, the other algorithms do not need its memory
+bool Solve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions, std::unique_ptr<SearchState>& state);
 
 
-bool Solve (ErrorHandler error_handler, Setting& settings, Actions& actions, Cube start_cube, uint64_t& num_positions);
+// compares decoding the hash with unpacking the pieces of queue entries
+void QueueBenchmark (ErrorHandler error_handler, Setting& settings, std::mt19937& rng);
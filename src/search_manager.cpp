@@ -1,19 +1,24 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <iomanip>
 #include <numeric>
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <nadeau.h>
 
 
 #include "actions.h"
 #include "error_handler.h"
+#include "puppet_cube.h"
 #include "search.h"
 #include "settings.h"
-#include "tablebase.h"
+#include "socket_server.h"
+#include "stream_solver.h"
 
 
 std::string PrecisionDouble (double number) {
@@ -102,8 +107,96 @@ void ShowSearchStatistic (ErrorHandler error_handler, Setting& settings, size_t
 }
 
 
-void SearchManager (ErrorHandler error_handler, Setting& settings, Actions& actions, std::mt19937& rng) {
-    TablebaseSearch(error_handler, settings, settings.tablebase_depth);
+// one run of a batch
+struct BatchRun {
+    Cube cube;
+    uint64_t scramble_depth = 0;
+
+    bool solved = false;
+    int depth = 0;
+    uint64_t num_positions = 0;
+    double time = 0;
+};
+
+
+// solves concurrent_solves runs at once, every solver has its own search state and actions
+// the pattern databases and the tablebase are shared
+void BatchSearch (ErrorHandler error_handler, Setting& settings, Actions& actions, std::mt19937& rng, const PuppetCube& puppet_cube) {
+    // the scrambles are the same as the ones of the runs one after another
+    std::vector<BatchRun> runs;
+    Cube cube;
+    for (int run = 0; run < settings.num_runs + settings.start_offset; run++) {
+        uint64_t scramble_depth = RandomRotations(settings, cube, actions, settings.scramble_depth, rng, false);
+        if (run >= settings.start_offset) {
+            runs.push_back({cube, scramble_depth});
+        }
+        cube = Cube();
+    }
+
+    std::atomic<int> next_run = 0;
+    std::atomic<int> num_unfinished = runs.size();
+    {
+        std::vector<std::jthread> solvers;
+        for (int i = 0; i < std::min(settings.concurrent_solves, int(runs.size())); i++) {
+            solvers.push_back(std::jthread([&]() {
+                SolveState state(puppet_cube);
+                for (int run = next_run++; run < int(runs.size()) && !actions.stop; run = next_run++) {
+                    BatchRun& batch_run = runs[run];
+                    SolveOptions options;
+                    options.num_threads = ThreadsPerSolve(settings, batch_run.cube, num_unfinished);
+
+                    SolveResult result = puppet_cube.Solve(state, batch_run.cube, options);
+                    batch_run.solved = result.solved;
+                    batch_run.time = result.time_s;
+                    batch_run.depth = result.solution.size();
+                    batch_run.num_positions = result.num_positions;
+                    --num_unfinished;
+
+                    if (batch_run.solved) {
+                        error_handler.Handle(ErrorHandler::Level::kAll, "search_manager.cpp", std::to_string(run + settings.start_offset) + ": Found solution of depth " + std::to_string(batch_run.depth) +
+                                             " visiting " + std::to_string(batch_run.num_positions) + " positions on " + std::to_string(options.num_threads) + " threads");
+                    }
+                }
+            }));
+        }
+    }
+
+    // statistic of the solved runs
+    std::vector<double> time_durations;
+    std::vector<int> search_depths;
+    std::vector<uint64_t> all_num_positions;
+    std::vector<uint64_t> scramble_depths;
+    for (const BatchRun& batch_run : runs) {
+        if (batch_run.solved) {
+            time_durations.push_back(batch_run.time);
+            search_depths.push_back(batch_run.depth);
+            all_num_positions.push_back(batch_run.num_positions);
+            scramble_depths.push_back(batch_run.scramble_depth);
+        }
+    }
+    ShowSearchStatistic(error_handler, settings, search_depths.size(), time_durations, search_depths, scramble_depths, all_num_positions);
+}
+
+
+void SearchManager (ErrorHandler error_handler, Setting& settings, Actions& actions, std::mt19937& rng, const PuppetCube& puppet_cube) {
+    if (settings.benchmark) {
+        QueueBenchmark(error_handler, settings, rng);
+        return;
+    }
+
+    if (!settings.input.empty()) {
+        StreamSolve(error_handler, settings, actions, puppet_cube);
+        return;
+    }
+    if (!settings.socket.empty()) {
+        ServeSocket(error_handler, settings, actions, puppet_cube);
+        return;
+    }
+
+    if (settings.concurrent_solves > 1) {
+        BatchSearch(error_handler, settings, actions, rng, puppet_cube);
+        return;
+    }
 
     error_handler.Handle(ErrorHandler::Level::kMemory, "search_manager.cpp", "currently using " + std::to_string(getCurrentRSS()/1000000) + " MB"); // NOLINT
     Cube cube;
@@ -114,6 +207,9 @@ void SearchManager (ErrorHandler error_handler, Setting& settings, Actions& acti
     std::vector<uint64_t> all_num_positions;
     std::vector<uint64_t> scramble_depths;
 
+    // reused by all runs, closing the window stops the solve
+    SolveState state(puppet_cube, actions);
+
     for (int run = 0; run < settings.num_runs + settings.start_offset; run++) {
         if (actions.stop) {
             break;
@@ -130,33 +226,30 @@ void SearchManager (ErrorHandler error_handler, Setting& settings, Actions& acti
         }
 
         actions.Push(Action(Instructions::kIsScrambling, Rotations()), settings);
-        scramble_depths.push_back(RandomRotations(settings, cube, actions, settings.scramble_depth, rng, true));
+        uint64_t scramble_depth = RandomRotations(settings, cube, actions, settings.scramble_depth, rng, true);
         actions.Push(Action(Instructions::kIsSolving, Rotations()), settings);
 
         error_handler.Handle(ErrorHandler::Level::kExtra, "search_manager.cpp", "Corner heuristic: " + std::to_string(cube.GetCornerHeuristic()));
 
         // solve cube
-        uint64_t num_positions = 0;
-        if (Solve(error_handler, settings, actions, cube, num_positions)) {
-            error_handler.Handle(ErrorHandler::Level::kAll, "search_manager.cpp",  std::to_string(run) + ": Found solution of depth " + std::to_string(actions.solve.size()) + " visiting " + std::to_string(num_positions) + " positions");
+        // a cancel request belongs to the run it was made for
+        state.ClearCancel();
+        SolveResult result = puppet_cube.Solve(state, cube);
+        if (result.solved) {
+            error_handler.Handle(ErrorHandler::Level::kAll, "search_manager.cpp",  std::to_string(run) + ": Found solution of depth " + std::to_string(result.solution.size()) + " visiting " + std::to_string(result.num_positions) + " positions");
 
-            // statistic
-            search_depths.push_back(actions.solve.size());
-            all_num_positions.push_back(num_positions);
+            // statistic of the solved runs
+            search_depths.push_back(result.solution.size());
+            all_num_positions.push_back(result.num_positions);
+            scramble_depths.push_back(scramble_depth);
+            time_durations.push_back(std::chrono::duration<double>(std::chrono::system_clock::now() - start_time).count());
 
             // show solution
-            while (!actions.solve.empty()) {
-                actions.Push(Action(Instructions::kRotation, actions.solve.top()), settings);
-                actions.solve.pop();
+            for (Rotations rotation : result.solution) {
+                actions.Push(Action(Instructions::kRotation, rotation), settings);
             }
         }
 
-        auto end_time = std::chrono::system_clock::now();
-        std::chrono::duration<double> time_duration = end_time - start_time;
-        if (!actions.stop) {
-            time_durations.push_back(time_duration.count());
-        }
-
         actions.Push(Action(Instructions::kReset, Rotations()), settings);
         cube = Cube();
     }
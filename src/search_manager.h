@@ -2,7 +2,8 @@
 
 #include "actions.h"
 #include "error_handler.h"
+#include "puppet_cube.h"
 #include "settings.h"
 
 
-void SearchManager (ErrorHandler error_handler, Setting& settings, Actions& actions, std::mt19937& rng);
+void SearchManager (ErrorHandler error_handler, Setting& settings, Actions& actions, std::mt19937& rng, const PuppetCube& puppet_cube);
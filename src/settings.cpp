@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstddef>
 #include <iomanip>
 #include <ios>
@@ -12,10 +13,13 @@
 #include "settings.h"
 
 
-Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) {
+Setting::Setting() {
     // use all posible threads
     num_threads = std::thread::hardware_concurrency();
+}
+
 
+Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) : Setting() {
     #ifdef GUI
     gui = true;
     #endif // GUI
@@ -38,13 +42,39 @@ Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) {
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--gui" << "graphical user interface [true/false]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--rootPath" << "path to puppet-cube-v2/" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--errorLevel" << "amount of output [criticalError/error/info/all/extra/memory]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--algorithm" << "search algorithm [astar/ida/bidirectional]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--strategy" << "quick search bounding the astar search [exact/weighted/beam]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--weight" << "heuristic weight of the weighted strategy [double >= 0]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--beam_width" << "positions kept per depth by the beam strategy [int >= 1]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--quick_positions" << "positions of the quick search on top of --positions, then the exact search goes on alone [int64_t >= 0]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--quick_time_limit_ms" << "time limit of the quick search, 0 has no limit [int64_t >= 0]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--threads" << "number of threads [int >= 1]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--pin_threads" << "pins every worker thread to one cpu, linux only [true/false]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--concurrent_solves" << "runs solved at once sharing the threads, needs --gui=false [int >= 1]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--input" << "file of scrambles solved line by line instead of random runs, - reads stdin" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--output" << "file the json line of every solved --input line is written to, - writes stdout and the messages to stderr" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--socket" << "unix socket solve requests are served on instead of random runs, empty disables it" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--runs" << "number of runs/start positions/scrambles [int >= 0]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--positions" << "number of positions searched [int64_t >= 0]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--time_limit_ms" << "time limit per solve keeping the best solution so far, 0 has no limit [int64_t >= 0]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--tablebase_depth" << "depth of tablebase [int >= 0] be aware 9 is already ca. 40GB RAM" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--tablebase_build" << "tablebase layers as hash sets or as sorted arrays with less memory [hash/sort]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--shared_tables" << "tables file attached by all solver processes, e.g. on /dev/shm or hugetlbfs, built if missing" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--scramble_depth" << "scramble depth [int >= 0]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--start_offset" << "start offset to start from a different position [int >= 0]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--min_depth" << "stops if it found a solution less or equal to min_depth [int >= 0]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--visited_memory" << "size of a fixed visited table in MB split among the concurrent solves, 0 uses a growing hash map [int >= 0]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--visited_replacement" << "replaces entries of a full visited table [exact/depth/age]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--visited_gc" << "removes visited positions that cannot lead to a shorter solution [true/false]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--visited_rotations" << "the visited hash map stores the rotation leading to a position [true/false]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--partial_expansion" << "requeued positions skip the children they already handled [true/false]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--spill_dir" << "directory for queued positions that do not fit into memory, only bounds the open list, --visited_memory bounds the visited positions, empty disables it" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--spill_memory" << "queued positions kept in memory before spilling in MB split among the concurrent solves [int >= 1]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--checkpoint" << "file the search is written to periodically, empty disables it" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--checkpoint_interval_s" << "seconds between two checkpoints [int >= 1]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--resume" << "checkpoint to continue the search of the same start position from" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--recent_filter" << "per thread cache of 2^n recently seen positions, 0 disables it [24 >= int >= 0]" << std::endl;
+            help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--benchmark" << "compares decoding hashed and packed queue entries for --positions [true/false]" << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << std::setw(align) << "--min_coner_heuristic" << "scrambles until it finds a cube with this corner heuristic or higher [27 >= int >= 0]" << std::endl;
             help_description << std::endl;
             help_description << std::setw(Setting::kIndent) << "" << "Example: ./build/bin/PuppetCubeV2 --gui=false --rootPath=./ --errorLevel=extra --threads=1 --runs=10 --positions=1000000 --tablebase_depth=7 --scramble_depth=10" << std::endl;
@@ -96,10 +126,75 @@ Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) {
             }
         }
 
+        else if (argument.find("--algorithm=") == 0) {
+            argument = argument.erase(0, std::string("--algorithm=").size());
+            if (argument == "astar") {
+                algorithm = Algorithm::kAStar;
+            }
+            else if (argument == "ida") {
+                algorithm = Algorithm::kIda;
+            }
+            else if (argument == "bidirectional") {
+                algorithm = Algorithm::kBidirectional;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "algorithm argument not found. Should be astar/ida/bidirectional");
+            }
+        }
+
+        else if (argument.find("--strategy=") == 0) {
+            argument = argument.erase(0, std::string("--strategy=").size());
+            if (argument == "exact") {
+                strategy = Strategy::kExact;
+            }
+            else if (argument == "weighted") {
+                strategy = Strategy::kWeighted;
+            }
+            else if (argument == "beam") {
+                strategy = Strategy::kBeam;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "strategy argument not found. Should be exact/weighted/beam");
+            }
+        }
+
+        else if (argument.find("--weight=") == 0) {
+            weight = std::max(std::stod(argument.erase(0, std::string("--weight=").size())), 0.0);
+        }
+
+        else if (argument.find("--beam_width=") == 0) {
+            beam_width = std::max(std::stoi(argument.erase(0, std::string("--beam_width=").size())), 1);
+        }
+
+        else if (argument.find("--quick_positions=") == 0) {
+            quick_positions = std::max(std::stoll(argument.erase(0, std::string("--quick_positions=").size())), 0LL);
+        }
+
+        else if (argument.find("--quick_time_limit_ms=") == 0) {
+            quick_time_limit_ms = std::max(std::stoll(argument.erase(0, std::string("--quick_time_limit_ms=").size())), 0LL);
+        }
+
         else if (argument.find("--threads=") == 0) {
             num_threads = std::stoi(argument.erase(0, std::string("--threads=").size()));
         }
 
+        else if (argument.find("--pin_threads=") == 0) {
+            argument = argument.erase(0, std::string("--pin_threads=").size());
+            if (argument == "true") {
+                pin_threads = true;
+            }
+            else if (argument == "false") {
+                pin_threads = false;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "pin threads argument not found. Should be true/false");
+            }
+        }
+
+        else if (argument.find("--concurrent_solves=") == 0) {
+            concurrent_solves = std::max(std::stoi(argument.erase(0, std::string("--concurrent_solves=").size())), 1);
+        }
+
         else if (argument.find("--runs=") == 0) {
             num_runs = std::stoi(argument.erase(0, std::string("--runs=").size()));
         }
@@ -108,10 +203,27 @@ Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) {
             max_num_positions = std::stoll(argument.erase(0, std::string("--positions=").size()));
         }
 
+        else if (argument.find("--time_limit_ms=") == 0) {
+            time_limit_ms = std::stoll(argument.erase(0, std::string("--time_limit_ms=").size()));
+        }
+
         else if (argument.find("--tablebase_depth=") == 0) {
             tablebase_depth = std::stoi(argument.erase(0, std::string("--tablebase_depth=").size()));
         }
 
+        else if (argument.find("--tablebase_build=") == 0) {
+            argument = argument.erase(0, std::string("--tablebase_build=").size());
+            if (argument == "hash") {
+                tablebase_build = TablebaseBuild::kHash;
+            }
+            else if (argument == "sort") {
+                tablebase_build = TablebaseBuild::kSort;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "tablebase_build argument not found. Should be hash/sort");
+            }
+        }
+
         else if (argument.find("--scramble_depth=") == 0) {
             scramble_depth = std::stoi(argument.erase(0, std::string("--scramble_depth=").size()));
         }
@@ -124,6 +236,118 @@ Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) {
             min_depth = std::stoi(argument.erase(0, std::string("--min_depth=").size()));
         }
 
+        else if (argument.find("--visited_memory=") == 0) {
+            visited_memory = std::stoi(argument.erase(0, std::string("--visited_memory=").size()));
+        }
+
+        else if (argument.find("--visited_replacement=") == 0) {
+            argument = argument.erase(0, std::string("--visited_replacement=").size());
+            if (argument == "exact") {
+                visited_replacement = Replacement::kExact;
+            }
+            else if (argument == "depth") {
+                visited_replacement = Replacement::kDepth;
+            }
+            else if (argument == "age") {
+                visited_replacement = Replacement::kAge;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "visited replacement argument not found. Should be exact/depth/age");
+            }
+        }
+
+        else if (argument.find("--visited_gc=") == 0) {
+            argument = argument.erase(0, std::string("--visited_gc=").size());
+            if (argument == "true") {
+                visited_gc = true;
+            }
+            else if (argument == "false") {
+                visited_gc = false;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "visited gc argument not found. Should be true/false");
+            }
+        }
+
+        else if (argument.find("--visited_rotations=") == 0) {
+            argument = argument.erase(0, std::string("--visited_rotations=").size());
+            if (argument == "true") {
+                visited_rotations = true;
+            }
+            else if (argument == "false") {
+                visited_rotations = false;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "visited rotations argument not found. Should be true/false");
+            }
+        }
+
+        else if (argument.find("--partial_expansion=") == 0) {
+            argument = argument.erase(0, std::string("--partial_expansion=").size());
+            if (argument == "true") {
+                partial_expansion = true;
+            }
+            else if (argument == "false") {
+                partial_expansion = false;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "partial expansion argument not found. Should be true/false");
+            }
+        }
+
+        else if (argument.find("--input=") == 0) {
+            input = argument.erase(0, std::string("--input=").size());
+        }
+
+        else if (argument.find("--output=") == 0) {
+            output = argument.erase(0, std::string("--output=").size());
+        }
+
+        else if (argument.find("--socket=") == 0) {
+            socket = argument.erase(0, std::string("--socket=").size());
+        }
+
+        else if (argument.find("--shared_tables=") == 0) {
+            shared_tables = argument.erase(0, std::string("--shared_tables=").size());
+        }
+
+        else if (argument.find("--spill_dir=") == 0) {
+            spill_dir = argument.erase(0, std::string("--spill_dir=").size());
+        }
+
+        else if (argument.find("--spill_memory=") == 0) {
+            spill_memory = std::max(std::stoi(argument.erase(0, std::string("--spill_memory=").size())), 1);
+        }
+
+        else if (argument.find("--checkpoint=") == 0) {
+            checkpoint = argument.erase(0, std::string("--checkpoint=").size());
+        }
+
+        else if (argument.find("--checkpoint_interval_s=") == 0) {
+            checkpoint_interval_s = std::max(std::stoi(argument.erase(0, std::string("--checkpoint_interval_s=").size())), 1);
+        }
+
+        else if (argument.find("--resume=") == 0) {
+            resume = argument.erase(0, std::string("--resume=").size());
+        }
+
+        else if (argument.find("--recent_filter=") == 0) {
+            recent_filter_bits = std::clamp(std::stoi(argument.erase(0, std::string("--recent_filter=").size())), 0, 24); // NOLINT
+        }
+
+        else if (argument.find("--benchmark=") == 0) {
+            argument = argument.erase(0, std::string("--benchmark=").size());
+            if (argument == "true") {
+                benchmark = true;
+            }
+            else if (argument == "false") {
+                benchmark = false;
+            }
+            else {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "benchmark argument not found. Should be true/false");
+            }
+        }
+
         else if (argument.find("--min_coner_heuristic=") == 0) {
             min_coner_heuristic = std::stoi(argument.erase(0, std::string("--min_coner_heuristic=").size()));
         }
@@ -132,4 +356,56 @@ Setting::Setting(ErrorHandler& error_handler, int argc, char *argv[]) {
             error_handler.Handle(ErrorHandler::Level::kInfo, "settings.cpp", "could not find a setting for: " + argument);
         }
     }
+
+    // the window shows one solve at a time and a checkpoint belongs to one search
+    if ((!input.empty() || !socket.empty()) && gui) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "settings.cpp", "--input and --socket need --gui=false");
+        gui = false;
+    }
+    if (concurrent_solves > 1 && gui) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "settings.cpp", "concurrent solves need --gui=false");
+        concurrent_solves = 1;
+    }
+    if (concurrent_solves > 1 && (!checkpoint.empty() || !resume.empty())) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "checkpoints are not written or resumed with concurrent solves");
+        checkpoint.clear();
+        resume.clear();
+    }
+
+    // the messages would be mixed into the json lines
+    if (!input.empty() && output == "-") {
+        error_handler.use_stderr = true;
+    }
+    // the benchmark does not search
+    if (benchmark) {
+        tablebase_depth = 0;
+    }
+
+    // the table needs at least 2^22 slots or buckets to identify positions
+    int min_visited_memory = visited_replacement == Replacement::kExact ? 32 : 128; // NOLINT
+    if (visited_replacement != Replacement::kExact && visited_memory == 0) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "settings.cpp", "visited replacement needs a fixed visited table");
+        visited_memory = min_visited_memory;
+    }
+    if (visited_memory != 0 && visited_memory < min_visited_memory) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "visited memory is at least " + std::to_string(min_visited_memory) + " MB");
+        visited_memory = min_visited_memory;
+    }
+
+    // the visited positions stay in memory, only a fixed table keeps them within a budget
+    if (!spill_dir.empty() && visited_memory == 0) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "settings.cpp", "--spill_dir only bounds the open list, --visited_memory bounds the visited positions");
+    }
+
+    // every concurrent solver builds its own visited table and open list from these budgets
+    if (concurrent_solves > 1) {
+        spill_memory = std::max(spill_memory / concurrent_solves, 1);
+        if (visited_memory != 0) {
+            visited_memory /= concurrent_solves;
+            if (visited_memory < min_visited_memory) {
+                error_handler.Handle(ErrorHandler::Level::kWarning, "settings.cpp", "visited memory is at least " + std::to_string(min_visited_memory) + " MB per concurrent solve");
+                visited_memory = min_visited_memory;
+            }
+        }
+    }
 }
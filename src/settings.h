@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <utility>
 
@@ -9,6 +10,9 @@
 
 class Setting {
 public:
+    // default settings of a program embedding the solver
+    Setting();
+    // settings of the command line
     Setting(ErrorHandler& error_handler, int argc, char *argv[]);
 
     // path to files
@@ -32,10 +36,84 @@ public:
     float scrambling_multiplier = 400;
 
     // search
+    enum class Algorithm {
+        kAStar, // best first search remembering all visited positions
+        kIda,   // iterative deepening depth first search with almost no memory
+        kBidirectional // searches from both sides without using the tablebase
+    };
+    Algorithm algorithm = Algorithm::kAStar;
+
+    // quick search before the exact A* search, its solution bounds the exact search
+    enum class Strategy {
+        kExact,    // only the exact search
+        kWeighted, // weighted A* f = depth + weight * (corner + edge 1 + edge 2 heuristic)
+        kBeam      // breadth first search keeping the beam_width best positions of every depth
+    };
+    Strategy strategy = Strategy::kExact;
+    double weight = 1;
+    int beam_width = 1000;
+    // own budget of the quick search, it does not count against max_num_positions
+    uint64_t quick_positions = 50000;
+    int64_t quick_time_limit_ms = 1000; // 0 has no limit
     int num_threads = 0;
+    bool pin_threads = false; // one cpu per worker of the thread pool
+    int concurrent_solves = 1; // runs solved at once, sharing the threads
     int tablebase_depth = 5;
+
+    // how the tablebase layers are built and stored
+    enum class TablebaseBuild {
+        kHash, // hash set per layer, new positions are inserted by all threads
+        kSort  // sorted array per layer, new positions are sorted and merged against the previous layers
+    };
+    TablebaseBuild tablebase_build = TablebaseBuild::kHash;
+    // file of the pattern databases and the tablebase shared by the solver processes, empty disables it
+    std::string shared_tables;
     uint64_t max_num_positions = 10000000;
+    int64_t time_limit_ms = 0; // per solve, 0 has no limit
     int min_depth = 0;
+    int visited_memory = 0; // MB per solve, 0 uses a growing hash map
+
+    // replacement policy of the fixed visited table
+    enum class Replacement {
+        kExact, // never replaces entries
+        kDepth, // replaces the deepest entry of a full bucket
+        kAge    // replaces the oldest entry of a full bucket
+    };
+    Replacement visited_replacement = Replacement::kExact;
+
+    // removes visited positions that cannot lead to a shorter solution anymore
+    bool visited_gc = false;
+
+    // the growing map stores the rotation leading to a position, otherwise only its depth
+    bool visited_rotations = true;
+
+    // requeued positions only generate the children they have not admitted yet
+    bool partial_expansion = true;
+
+    // queued positions beyond spill_memory MB per solve are written to run files in spill_dir, empty keeps all in memory
+    // the visited positions are not spilled, visited_memory bounds them
+    std::string spill_dir;
+    int spill_memory = 1024;
+
+    // the astar search is written to checkpoint every checkpoint_interval_s seconds, empty disables it
+    std::string checkpoint;
+    int checkpoint_interval_s = 600;
+    // checkpoint to continue the search of the same start position from
+    std::string resume;
+
+    // per thread cache of 2^recent_filter_bits recently seen positions, 0 disables it
+    int recent_filter_bits = 12;
+
+    // only compares the queue entry formats
+    bool benchmark = false;
+
+    // scrambles read line by line from input (- is stdin) instead of random runs, empty disables it
+    // one json line per solve is written to output (- is stdout)
+    std::string input;
+    std::string output = "-";
+
+    // unix socket the solver serves requests on with the loaded tables, empty disables it
+    std::string socket;
 
     // scramble
     int num_runs = 1000;
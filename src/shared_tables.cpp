@@ -0,0 +1,170 @@
+#include <bit>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#include "cube.h"
+#include "error_handler.h"
+#include "settings.h"
+#include "shared_tables.h"
+#include "tablebase.h"
+
+
+#ifndef _WIN32
+
+constexpr uint64_t kMagic = 0x53454c4241544350; // "PCTABLES"
+constexpr uint32_t kVersion = 2;
+// every table starts at a cache line
+constexpr uint64_t kAlignment = 64;
+
+
+struct Header {
+    uint64_t magic;
+    uint32_t version;
+    // positions of depth 0 to tablebase_depth
+    uint32_t tablebase_depth;
+    uint64_t file_size;
+    uint64_t position_data_offset;
+    uint64_t edge_data_offset;
+    uint64_t tablebase_offset;
+    uint64_t tablebase_slots;
+};
+
+
+uint64_t Align (uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+
+// the table of size bytes at offset is aligned and lies within the file
+bool InFile (uint64_t offset, uint64_t size, uint64_t file_size) {
+    return offset % kAlignment == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+
+// a damaged or foreign header must not let the tables point beyond the mapping
+bool ValidLayout (const Header& header) {
+    return InFile(header.position_data_offset, kNumPositions * sizeof(uint16_t), header.file_size) &&
+           InFile(header.edge_data_offset, kNumEdgePositions * sizeof(uint8_t), header.file_size) &&
+           std::has_single_bit(header.tablebase_slots) && header.tablebase_slots <= header.file_size / sizeof(Cube::Hash) &&
+           InFile(header.tablebase_offset, header.tablebase_slots * sizeof(Cube::Hash), header.file_size);
+}
+
+
+// the tables are read from the mapped file from now on, the mapping lives as long as the process
+void UseSharedTables (const char* data, const Header& header, int tablebase_depth) {
+    UsePatternTables(reinterpret_cast<const uint16_t*>(data + header.position_data_offset), reinterpret_cast<const uint8_t*>(data + header.edge_data_offset));
+    UseFrozenTablebase(reinterpret_cast<const Cube::Hash*>(data + header.tablebase_offset), header.tablebase_slots, tablebase_depth);
+}
+
+#endif
+
+
+bool AttachSharedTables (ErrorHandler error_handler, const Setting& settings) {
+    #ifdef _WIN32
+    error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", "--shared_tables needs mmap");
+    return false;
+    #else
+    int file = open(settings.shared_tables.c_str(), O_RDONLY);
+    if (file < 0) {
+        error_handler.Handle(ErrorHandler::Level::kInfo, "shared_tables.cpp", "no shared tables at " + settings.shared_tables + " yet");
+        return false;
+    }
+    struct stat status;
+    Header header;
+    bool valid = fstat(file, &status) == 0 && uint64_t(status.st_size) >= sizeof(Header) && pread(file, &header, sizeof(Header), 0) == sizeof(Header) &&
+                 header.magic == kMagic && header.version == kVersion && header.file_size <= uint64_t(status.st_size) && ValidLayout(header);
+    if (!valid) {
+        close(file);
+        error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", settings.shared_tables + " are damaged or no shared tables of this version");
+        return false;
+    }
+    if (int(header.tablebase_depth) < settings.tablebase_depth) {
+        close(file);
+        error_handler.Handle(ErrorHandler::Level::kInfo, "shared_tables.cpp", "the shared tables only have tablebase depth " + std::to_string(header.tablebase_depth));
+        return false;
+    }
+
+    void* data = mmap(nullptr, header.file_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", "could not map " + settings.shared_tables + ": " + std::strerror(errno));
+        return false;
+    }
+    UseSharedTables(static_cast<const char*>(data), header, settings.tablebase_depth);
+    error_handler.Handle(ErrorHandler::Level::kInfo, "shared_tables.cpp", "attached shared tables " + settings.shared_tables + " with tablebase depth " + std::to_string(settings.tablebase_depth));
+    return true;
+    #endif
+}
+
+
+bool WriteSharedTables (ErrorHandler error_handler, const Setting& settings) {
+    #ifdef _WIN32
+    error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", "--shared_tables needs mmap");
+    return false;
+    #else
+    Header header = {};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.tablebase_depth = GetTablebaseDepth();
+    uint64_t offset = Align(sizeof(Header), kAlignment);
+    header.position_data_offset = offset;
+    offset = Align(offset + kNumPositions * sizeof(uint16_t), kAlignment);
+    header.edge_data_offset = offset;
+    offset = Align(offset + kNumEdgePositions * sizeof(uint8_t), kAlignment);
+    header.tablebase_offset = offset;
+    header.tablebase_slots = FrozenTablebaseSlots();
+    offset = Align(offset + header.tablebase_slots * sizeof(Cube::Hash), kAlignment);
+
+    // a loader running at the same time writes its own file
+    std::string temp_file_name = settings.shared_tables + ".tmp" + std::to_string(getpid());
+    int file = open(temp_file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644); // NOLINT
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", "could not create " + temp_file_name + ": " + std::strerror(errno));
+        if (file >= 0) {
+            close(file);
+        }
+        return false;
+    }
+    // hugetlbfs only maps whole huge pages, its block size
+    header.file_size = Align(offset, status.st_blksize);
+
+    // hugetlbfs files can only be written through a mapping
+    void* data = MAP_FAILED;
+    if (ftruncate(file, header.file_size) == 0) {
+        data = mmap(nullptr, header.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    if (data == MAP_FAILED) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", "could not map " + temp_file_name + ": " + std::strerror(errno));
+        close(file);
+        unlink(temp_file_name.c_str());
+        return false;
+    }
+    char* bytes = static_cast<char*>(data);
+    std::memcpy(bytes, &header, sizeof(Header));
+    std::memcpy(bytes + header.position_data_offset, PositionDataTable(), kNumPositions * sizeof(uint16_t));
+    std::memcpy(bytes + header.edge_data_offset, EdgeDataTable(), kNumEdgePositions * sizeof(uint8_t));
+    FreezeTablebase(reinterpret_cast<Cube::Hash*>(bytes + header.tablebase_offset));
+    munmap(data, header.file_size);
+    close(file);
+
+    // replaces an older file at once
+    if (std::rename(temp_file_name.c_str(), settings.shared_tables.c_str()) != 0) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "shared_tables.cpp", "could not replace " + settings.shared_tables + ": " + std::strerror(errno));
+        unlink(temp_file_name.c_str());
+        return false;
+    }
+    error_handler.Handle(ErrorHandler::Level::kInfo, "shared_tables.cpp", "wrote shared tables " + settings.shared_tables + " of " + std::to_string(header.file_size / 1000000) + " MB"); // NOLINT
+    return AttachSharedTables(error_handler, settings);
+    #endif
+}
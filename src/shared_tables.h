@@ -0,0 +1,19 @@
+#pragma once
+
+#include "error_handler.h"
+#include "settings.h"
+
+
+// the pattern databases and the frozen tablebase in one read only file mapped by every solver process
+// on /dev/shm or a hugetlbfs mount the processes share its pages
+//
+// the file holds a header followed by the tables at offsets from its start:
+// position data, edge data and the frozen tablebase of depth 0 to tablebase_depth
+
+// maps --shared_tables if it holds at least --tablebase_depth, its tables are used from now on
+// returns false if the file is missing or does not fit
+bool AttachSharedTables (ErrorHandler error_handler, const Setting& settings);
+
+// writes the loaded pattern databases and the tablebase to --shared_tables and attaches it
+// the file is replaced once it is complete, processes attached to the old file keep it
+bool WriteSharedTables (ErrorHandler error_handler, const Setting& settings);
@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+#include "actions.h"
+#include "error_handler.h"
+#include "puppet_cube.h"
+#include "search.h"
+#include "settings.h"
+#include "socket_server.h"
+#include "stream_solver.h"
+
+
+#ifndef _WIN32
+
+// a client sending a longer line without newline is disconnected
+constexpr size_t kMaxLineBytes = size_t(1) << 16;
+// a client not reading more than this of its responses is disconnected
+constexpr size_t kMaxOutputBytes = size_t(1) << 22;
+// the accept loop checks actions.stop this often
+constexpr int kPollIntervalMs = 200;
+
+
+struct Request;
+
+
+// one client, the responses of the solvers are queued as whole lines and sent by the poll loop
+class Connection {
+public:
+    // the socket is non-blocking, writing to wake lets the poll loop send the queued responses
+    Connection (int socket, int wake) : socket_(socket), wake_(wake) {}
+    ~Connection () {
+        close(socket_);
+    }
+
+    int Socket () const {
+        return socket_;
+    }
+
+    // a client that does not read its responses only overflows its own output
+    void Write (const std::string& line) {
+        {
+            std::lock_guard<std::mutex> guard(write_mutex_);
+            if (overflowed_) {
+                return;
+            }
+            output_ += line;
+            output_ += '\n';
+            if (output_.size() > kMaxOutputBytes) {
+                overflowed_ = true;
+                output_.clear();
+            }
+        }
+        char wake = 0;
+        [[maybe_unused]] ssize_t size = write(wake_, &wake, 1);
+    }
+
+    bool HasOutput () {
+        std::lock_guard<std::mutex> guard(write_mutex_);
+        return !output_.empty();
+    }
+
+    bool Overflowed () {
+        std::lock_guard<std::mutex> guard(write_mutex_);
+        return overflowed_;
+    }
+
+    // sends as much of the output as the socket takes
+    // returns false once the client is gone
+    bool Flush () {
+        std::lock_guard<std::mutex> guard(write_mutex_);
+        size_t written = 0;
+        while (written < output_.size()) {
+            ssize_t size = send(socket_, output_.data() + written, output_.size() - written, 0);
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (size <= 0) {
+                output_.clear();
+                return false;
+            }
+            written += size;
+        }
+        output_.erase(0, written);
+        return true;
+    }
+
+    // received bytes of the unfinished line
+    std::string buffer;
+    uint64_t num_lines = 0;
+
+    // unanswered requests by id, guarded by the server mutex
+    std::map<std::string, std::shared_ptr<Request>> requests;
+
+private:
+    int socket_;
+    int wake_;
+    std::mutex write_mutex_;
+    std::string output_;
+    bool overflowed_ = false;
+};
+
+
+struct Request {
+    std::string id;
+    ScrambleLine scramble;
+    int64_t time_limit_ms = 0;
+    std::shared_ptr<Connection> connection;
+
+    // state of the solver while it solves the request
+    SolveState* solve_state = nullptr;
+};
+
+
+// response of a request, the id is put in front of the json line of the solve
+std::string Response (const std::string& id, const std::string& json) {
+    return "{\"id\":" + JsonString(id) + "," + json.substr(1);
+}
+
+
+class Server {
+public:
+    Server (Setting& settings, const PuppetCube& puppet_cube) : settings_(settings), puppet_cube_(puppet_cube) {
+        for (int i = 0; i < settings.concurrent_solves; i++) {
+            solvers_.push_back(std::jthread([this]() {
+                SolveRequests();
+            }));
+        }
+    }
+
+    ~Server () {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            stop_ = true;
+        }
+        request_added_.notify_all();
+    }
+
+    // a complete line of the client
+    void HandleLine (const std::shared_ptr<Connection>& connection, const std::string& line);
+
+    // cancels all requests of a client that disconnected
+    void Disconnect (const std::shared_ptr<Connection>& connection);
+
+private:
+    void SolveRequests ();
+
+    void Solve (const std::shared_ptr<Connection>& connection, const std::string& id, std::istringstream& tokens);
+    void Cancel (const std::shared_ptr<Connection>& connection, const std::string& id);
+
+    Setting& settings_;
+    const PuppetCube& puppet_cube_;
+
+    std::mutex mutex_;
+    std::condition_variable request_added_;
+    std::deque<std::shared_ptr<Request>> queue_;
+    int num_solving_ = 0;
+    bool stop_ = false;
+    std::vector<std::jthread> solvers_;
+};
+
+
+void Server::HandleLine (const std::shared_ptr<Connection>& connection, const std::string& line) {
+    connection->num_lines++;
+    std::istringstream tokens(line);
+    std::string command;
+    std::string id;
+    if (!(tokens >> command)) {
+        return;
+    }
+    if (!(tokens >> id)) {
+        connection->Write("{\"error\":" + JsonString("missing id of " + command) + "}");
+        return;
+    }
+
+    if (command == "solve") {
+        Solve(connection, id, tokens);
+    }
+    else if (command == "cancel") {
+        Cancel(connection, id);
+    }
+    else {
+        connection->Write("{\"id\":" + JsonString(id) + ",\"error\":" + JsonString("unknown command " + command + ", expected solve/cancel") + "}");
+    }
+}
+
+
+void Server::Solve (const std::shared_ptr<Connection>& connection, const std::string& id, std::istringstream& tokens) {
+    auto request = std::make_shared<Request>();
+    request->id = id;
+    request->time_limit_ms = settings_.time_limit_ms;
+    request->connection = connection;
+
+    // option in front of the scramble
+    std::string scramble;
+    std::getline(tokens >> std::ws, scramble);
+    const std::string time_limit_option = "time_limit_ms=";
+    if (scramble.find(time_limit_option) == 0) {
+        size_t end = scramble.find(' ');
+        std::string value = scramble.substr(time_limit_option.size(), end - time_limit_option.size());
+        scramble.erase(0, end);
+        scramble.erase(0, scramble.find_first_not_of(' '));
+        try {
+            request->time_limit_ms = std::max(std::stoll(value), 0LL);
+        }
+        catch (const std::exception&) {
+            connection->Write(Response(id, "{\"solved\":false,\"error\":" + JsonString("time_limit_ms=" + value + " is no number") + "}"));
+            return;
+        }
+    }
+    if (!ParseScramble(connection->num_lines, scramble, request->scramble)) {
+        connection->Write(Response(id, "{\"solved\":false,\"error\":\"missing scramble\"}"));
+        return;
+    }
+    // nothing to solve, so it does not wait for a solver
+    if (!request->scramble.error.empty()) {
+        connection->Write(Response(id, UnsolvedJson(request->scramble, request->scramble.error)));
+        return;
+    }
+
+    std::string refused;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (connection->requests.contains(id)) {
+            refused = "id is already used by an unanswered request";
+        }
+        else if (queue_.size() >= size_t(kQueuedPerSolver * settings_.concurrent_solves)) {
+            refused = "busy, " + std::to_string(queue_.size()) + " requests are queued";
+        }
+        else {
+            connection->requests[id] = request;
+            queue_.push_back(request);
+            request_added_.notify_one();
+        }
+    }
+    if (!refused.empty()) {
+        connection->Write(Response(id, "{\"solved\":false,\"error\":" + JsonString(refused) + "}"));
+    }
+}
+
+
+void Server::Cancel (const std::shared_ptr<Connection>& connection, const std::string& id) {
+    std::shared_ptr<Request> request;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto found = connection->requests.find(id);
+        if (found != connection->requests.end() && found->second->solve_state != nullptr) {
+            // the solver answers with the best solution so far
+            found->second->solve_state->Cancel();
+            return;
+        }
+        if (found != connection->requests.end()) {
+            request = found->second;
+            connection->requests.erase(found);
+            std::erase(queue_, request);
+        }
+    }
+    if (request == nullptr) {
+        connection->Write("{\"id\":" + JsonString(id) + ",\"error\":\"no unanswered request\"}");
+        return;
+    }
+    connection->Write(Response(id, UnsolvedJson(request->scramble, "cancelled")));
+}
+
+
+void Server::Disconnect (const std::shared_ptr<Connection>& connection) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto& [id, request] : connection->requests) {
+        if (request->solve_state != nullptr) {
+            request->solve_state->Cancel();
+        }
+        else {
+            std::erase(queue_, request);
+        }
+    }
+    connection->requests.clear();
+}
+
+
+void Server::SolveRequests () {
+    SolveState state(puppet_cube_);
+    while (true) {
+        std::shared_ptr<Request> request;
+        int num_unfinished;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            request_added_.wait(lock, [this]() {return !queue_.empty() || stop_;});
+            if (stop_) {
+                return;
+            }
+            request = queue_.front();
+            queue_.pop_front();
+            num_unfinished = queue_.size() + ++num_solving_;
+            // from now on a cancel reaches the solve
+            request->solve_state = &state;
+            state.ClearCancel();
+        }
+
+        SolveOptions options;
+        options.num_threads = ThreadsPerSolve(settings_, request->scramble.cube, num_unfinished);
+        options.time_limit_ms = request->time_limit_ms;
+        std::string json = SolveScramble(puppet_cube_, state, options, request->scramble);
+
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            num_solving_--;
+            request->solve_state = nullptr;
+            auto found = request->connection->requests.find(request->id);
+            if (found != request->connection->requests.end() && found->second == request) {
+                request->connection->requests.erase(found);
+            }
+        }
+        request->connection->Write(Response(request->id, json));
+    }
+}
+
+
+// reads the available bytes of the client and handles its complete lines
+// returns false once the client disconnected
+bool ReadLines (Server& server, const std::shared_ptr<Connection>& connection) {
+    char data[4096]; // NOLINT
+    ssize_t size = recv(connection->Socket(), data, sizeof(data), 0);
+    if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    }
+    if (size <= 0) {
+        return false;
+    }
+    connection->buffer.append(data, size);
+    for (size_t end = connection->buffer.find('\n'); end != std::string::npos; end = connection->buffer.find('\n')) {
+        std::string line = connection->buffer.substr(0, end);
+        connection->buffer.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        server.HandleLine(connection, line);
+    }
+    if (connection->buffer.size() > kMaxLineBytes) {
+        connection->Write("{\"error\":\"line too long\"}");
+        return false;
+    }
+    return true;
+}
+
+#endif
+
+
+void ServeSocket (ErrorHandler error_handler, Setting& settings, Actions& actions, const PuppetCube& puppet_cube) {
+    #ifdef _WIN32
+    error_handler.Handle(ErrorHandler::Level::kError, "socket_server.cpp", "--socket needs unix domain sockets");
+    #else
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (settings.socket.size() >= sizeof(address.sun_path)) {
+        error_handler.Handle(ErrorHandler::Level::kError, "socket_server.cpp", "--socket=" + settings.socket + " is too long");
+        return;
+    }
+    std::memcpy(address.sun_path, settings.socket.c_str(), settings.socket.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    // a socket file left by a daemon that did not stop cleanly
+    unlink(settings.socket.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        error_handler.Handle(ErrorHandler::Level::kError, "socket_server.cpp", "could not listen on --socket=" + settings.socket + ": " + std::strerror(errno));
+        if (listener >= 0) {
+            close(listener);
+        }
+        return;
+    }
+    // writing to a client that is gone must not end the daemon
+    std::signal(SIGPIPE, SIG_IGN);
+    // the solvers wake the poll loop to send their responses
+    int wake[2];
+    if (pipe(wake) != 0) {
+        error_handler.Handle(ErrorHandler::Level::kError, "socket_server.cpp", std::string("could not create the wake pipe: ") + std::strerror(errno));
+        close(listener);
+        return;
+    }
+    fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL) | O_NONBLOCK);
+
+    error_handler.Handle(ErrorHandler::Level::kInfo, "socket_server.cpp", "serving solve requests on " + settings.socket);
+    {
+        Server server(settings, puppet_cube);
+        std::vector<std::shared_ptr<Connection>> connections;
+        while (!actions.stop) {
+            // the listener and the wake pipe first, then one entry per client
+            constexpr size_t kNumFixed = 2;
+            std::vector<pollfd> poll_fds = {{listener, POLLIN, 0}, {wake[0], POLLIN, 0}};
+            for (const std::shared_ptr<Connection>& connection : connections) {
+                short events = POLLIN | (connection->HasOutput() ? POLLOUT : 0);
+                poll_fds.push_back({connection->Socket(), events, 0});
+            }
+            if (poll(poll_fds.data(), poll_fds.size(), kPollIntervalMs) <= 0) {
+                continue;
+            }
+            if (poll_fds[1].revents & POLLIN) {
+                char data[256]; // NOLINT
+                while (read(wake[0], data, sizeof(data)) > 0) {}
+            }
+
+            for (size_t i = poll_fds.size() - 1; i >= kNumFixed; i--) {
+                std::shared_ptr<Connection>& connection = connections[i - kNumFixed];
+                bool connected = true;
+                if (poll_fds[i].revents & POLLOUT) {
+                    connected = connection->Flush();
+                }
+                if (connected && (poll_fds[i].revents & ~POLLOUT) != 0) {
+                    connected = ReadLines(server, connection);
+                    // the error about a too long line
+                    connection->Flush();
+                }
+                if (connected && connection->Overflowed()) {
+                    error_handler.Handle(ErrorHandler::Level::kExtra, "socket_server.cpp", "client does not read its responses");
+                    connected = false;
+                }
+                if (!connected) {
+                    error_handler.Handle(ErrorHandler::Level::kExtra, "socket_server.cpp", "client disconnected");
+                    server.Disconnect(connection);
+                    connections.erase(connections.begin() + i - kNumFixed);
+                }
+            }
+            if (poll_fds[0].revents & POLLIN) {
+                int client = accept(listener, nullptr, nullptr);
+                if (client >= 0) {
+                    error_handler.Handle(ErrorHandler::Level::kExtra, "socket_server.cpp", "client connected");
+                    // a client that does not read must not block the poll loop
+                    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                    connections.push_back(std::make_shared<Connection>(client, wake[1]));
+                }
+            }
+        }
+        for (const std::shared_ptr<Connection>& connection : connections) {
+            server.Disconnect(connection);
+        }
+    }
+    close(wake[0]);
+    close(wake[1]);
+    close(listener);
+    unlink(settings.socket.c_str());
+    #endif
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "actions.h"
+#include "error_handler.h"
+#include "puppet_cube.h"
+#include "settings.h"
+
+
+// keeps the loaded tables and the thread pool and serves solve requests on the unix socket --socket
+// every request and response is one line, responses arrive when their solve finished:
+//
+// solve <id> [time_limit_ms=<n>] <scramble>   the scramble is a line of --input, 0 ms keeps --time_limit_ms
+//     {"id":"<id>","line":3,"input":"R U","solved":true,"solution":"U' R'","depth":2,"nodes":2,"time_s":0.001,"optimal":true}
+// cancel <id>                                  the solve keeps its best solution so far, a queued one is answered at once
+//
+// concurrent_solves requests of all clients are solved at once, more than kQueuedPerSolver per solver are refused
+// the ids of a client have to be unique among its unanswered requests
+// a client that does not read its responses is disconnected, it never blocks the others
+void ServeSocket (ErrorHandler error_handler, Setting& settings, Actions& actions, const PuppetCube& puppet_cube);
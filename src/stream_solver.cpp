@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "rotation.h"
+#include "puppet_cube.h"
+#include "search.h"
+#include "settings.h"
+#include "stream_solver.h"
+
+
+// hashes beyond these ranges do not decode to a cube
+constexpr uint64_t kNumEdgePositionHashes = 479001600; // 12!
+constexpr int kEdgeOrientationBits = Cube::kNumEdges;
+
+
+template <class Number>
+bool ParseNumber (const std::string& text, Number& number) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+
+// "<hash_1>:<hash_2>" of a position
+bool ParseHash (const std::string& text, Cube& cube) {
+    size_t separator = text.find(':');
+    Cube::Hash hash;
+    if (separator == std::string::npos || !ParseNumber(text.substr(0, separator), hash.hash_1) ||
+        !ParseNumber(text.substr(separator + 1), hash.hash_2)) {
+        return false;
+    }
+    uint64_t corner_hash = (hash.hash_1 << 36) >> 36; // NOLINT
+    uint64_t edge_hash = ((hash.hash_1 >> 28) << 8) | uint64_t(hash.hash_2); // NOLINT
+    if (corner_hash >= uint64_t(kNumPositions) || (edge_hash >> kEdgeOrientationBits) >= kNumEdgePositionHashes) {
+        return false;
+    }
+
+    // the hash has to be the one of the decoded pieces
+    Cube decoded = DecodeHash(hash);
+    cube = Cube();
+    cube.corners = decoded.corners;
+    cube.edges = decoded.edges;
+    Cube::Hash cube_hash = cube.GetHash();
+    return cube_hash.hash_1 == hash.hash_1 && cube_hash.hash_2 == hash.hash_2;
+}
+
+
+bool ParseScramble (uint64_t line_number, const std::string& input, ScrambleLine& scramble) {
+    scramble = ScrambleLine();
+    scramble.line_number = line_number;
+    scramble.input = input;
+    // lines of windows files
+    if (!scramble.input.empty() && scramble.input.back() == '\r') {
+        scramble.input.pop_back();
+    }
+
+    std::istringstream tokens(scramble.input);
+    std::string token;
+    if (!(tokens >> token) || token[0] == '#') {
+        return false;
+    }
+
+    if (token.find("hash:") == 0) {
+        if (!ParseHash(token.substr(std::string("hash:").size()), scramble.cube) || tokens >> token) {
+            scramble.error = "no position hash, expected hash:<hash_1>:<hash_2>";
+        }
+        return true;
+    }
+
+    int num_rotations = 0;
+    do {
+        // R2 and R2' are two R
+        int turns = 1;
+        size_t two = token.find('2');
+        if (two != std::string::npos && two > 0) {
+            turns = 2;
+            token.erase(two, 1);
+        }
+        Rotations rotation;
+        if (!ParseRotation(token, rotation)) {
+            scramble.error = "unknown rotation " + token;
+            return true;
+        }
+        for (int turn = 0; turn < turns; turn++) {
+            std::vector<Rotations> legal_rotations = GetLegalRotations(scramble.cube);
+            if (std::find(legal_rotations.begin(), legal_rotations.end(), rotation) == legal_rotations.end()) {
+                scramble.error = "rotation " + RotationName(rotation) + " is blocked after " + std::to_string(num_rotations) + " rotations";
+                return true;
+            }
+            scramble.cube = Rotate(scramble.cube, rotation);
+            num_rotations++;
+        }
+    } while (tokens >> token);
+    return true;
+}
+
+
+std::string JsonString (const std::string& text) {
+    std::stringstream json;
+    json << '"';
+    for (char character : text) {
+        if (character == '"' || character == '\\') {
+            json << '\\' << character;
+        }
+        else if (uint8_t(character) < 0x20) { // NOLINT
+            json << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(character) << std::dec;
+        }
+        else {
+            json << character;
+        }
+    }
+    json << '"';
+    return json.str();
+}
+
+
+std::string UnsolvedJson (const ScrambleLine& scramble, const std::string& error) {
+    return "{\"line\":" + std::to_string(scramble.line_number) + ",\"input\":" + JsonString(scramble.input) +
+           ",\"solved\":false,\"error\":" + JsonString(error) + "}";
+}
+
+
+std::string SolveScramble (const PuppetCube& puppet_cube, SolveState& state, const SolveOptions& options, const ScrambleLine& scramble) {
+    if (!scramble.error.empty()) {
+        return UnsolvedJson(scramble, scramble.error);
+    }
+    SolveResult result = puppet_cube.Solve(state, scramble.cube, options);
+
+    std::stringstream json;
+    json << std::boolalpha << "{\"line\":" << scramble.line_number << ",\"input\":" << JsonString(scramble.input) << ",\"solved\":" << result.solved;
+    if (result.solved) {
+        json << ",\"solution\":\"";
+        for (size_t i = 0; i < result.solution.size(); i++) {
+            json << (i == 0 ? "" : " ") << RotationName(result.solution[i]);
+        }
+        json << "\",\"depth\":" << result.solution.size();
+    }
+    else {
+        json << ",\"error\":\"no solution within " << result.num_positions << " positions\"";
+    }
+    json << ",\"nodes\":" << result.num_positions << ",\"time_s\":" << std::fixed << std::setprecision(3) << result.time_s <<
+            ",\"optimal\":" << result.optimal << "}";
+    return json.str();
+}
+
+
+void StreamSolve (ErrorHandler error_handler, Setting& settings, Actions& actions, const PuppetCube& puppet_cube) {
+    std::ifstream input_file;
+    std::istream* input = &std::cin;
+    if (settings.input != "-") {
+        input_file.open(settings.input);
+        if (!input_file) {
+            error_handler.Handle(ErrorHandler::Level::kError, "stream_solver.cpp", "could not open --input=" + settings.input);
+            return;
+        }
+        input = &input_file;
+    }
+    std::ofstream output_file;
+    std::ostream* output = &std::cout;
+    if (settings.output != "-") {
+        output_file.open(settings.output);
+        if (!output_file) {
+            error_handler.Handle(ErrorHandler::Level::kError, "stream_solver.cpp", "could not open --output=" + settings.output);
+            return;
+        }
+        output = &output_file;
+    }
+    // lines wait in a bounded queue until a solver takes them
+    // solved lines wait until all lines before them are written, a solver only takes a line
+    // while the waiting results and the running solves stay below the same bound
+    std::mutex mutex;
+    std::condition_variable line_read;
+    std::condition_variable line_taken;
+    std::condition_variable line_solved;
+    std::deque<std::pair<uint64_t, ScrambleLine>> lines;
+    std::map<uint64_t, std::string> results;
+    const size_t max_queued = kQueuedPerSolver * settings.concurrent_solves;
+    uint64_t num_lines = 0;
+    int num_solving = 0;
+    bool reading_done = false;
+
+    auto start_time = std::chrono::steady_clock::now();
+    uint64_t num_written = 0;
+    {
+        std::jthread reader([&]() {
+            std::string text;
+            uint64_t line_number = 0;
+            while (!actions.stop && std::getline(*input, text)) {
+                ScrambleLine scramble;
+                if (!ParseScramble(++line_number, text, scramble)) {
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                line_taken.wait(lock, [&]() {return lines.size() < max_queued;});
+                lines.push_back({num_lines++, std::move(scramble)});
+                line_read.notify_one();
+            }
+            std::lock_guard<std::mutex> guard(mutex);
+            reading_done = true;
+            line_read.notify_all();
+            line_solved.notify_all();
+        });
+
+        std::vector<std::jthread> solvers;
+        for (int i = 0; i < settings.concurrent_solves; i++) {
+            solvers.push_back(std::jthread([&]() {
+                SolveState state(puppet_cube);
+                while (true) {
+                    std::pair<uint64_t, ScrambleLine> line;
+                    int num_unfinished;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        line_read.wait(lock, [&]() {
+                            return (!lines.empty() && results.size() + num_solving < max_queued) || (lines.empty() && reading_done);
+                        });
+                        if (lines.empty()) {
+                            return;
+                        }
+                        line = std::move(lines.front());
+                        lines.pop_front();
+                        num_unfinished = lines.size() + ++num_solving;
+                        line_taken.notify_one();
+                    }
+
+                    // the remaining lines are still answered
+                    if (actions.stop && line.second.error.empty()) {
+                        line.second.error = "stopped before the solve";
+                    }
+                    SolveOptions options;
+                    options.num_threads = ThreadsPerSolve(settings, line.second.cube, num_unfinished);
+                    std::string result = SolveScramble(puppet_cube, state, options, line.second);
+
+                    std::lock_guard<std::mutex> guard(mutex);
+                    num_solving--;
+                    results[line.first] = std::move(result);
+                    line_solved.notify_all();
+                }
+            }));
+        }
+
+        // writes the lines in input order while the solvers continue
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            line_solved.wait(lock, [&]() {return results.contains(num_written) || (reading_done && num_written == num_lines);});
+            auto result = results.find(num_written);
+            if (result == results.end()) {
+                break;
+            }
+            std::string json = std::move(result->second);
+            results.erase(result);
+            num_written++;
+            line_read.notify_all();
+            lock.unlock();
+            *output << json << std::endl;
+            lock.lock();
+        }
+    }
+
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start_time;
+    error_handler.Handle(ErrorHandler::Level::kInfo, "stream_solver.cpp", "wrote " + std::to_string(num_written) + " json lines in " + std::to_string(duration.count()) + " s");
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+#include "actions.h"
+#include "cube.h"
+#include "error_handler.h"
+#include "puppet_cube.h"
+#include "settings.h"
+
+
+// lines waiting per solver, the reading pauses or requests are refused beyond it
+constexpr int kQueuedPerSolver = 4;
+
+
+// one line of the input
+struct ScrambleLine {
+    uint64_t line_number = 0;
+    std::string input;
+
+    // start position of the solve, only valid without error
+    Cube cube;
+    std::string error;
+};
+
+
+// a line holds rotations applied to the solved cube, e.g. "R U' F2"
+// or the hash of a position as "hash:<hash_1>:<hash_2>"
+// returns false if the line is empty or a # comment, otherwise the error is set if it could not be parsed
+bool ParseScramble (uint64_t line_number, const std::string& input, ScrambleLine& scramble);
+
+
+// text as json string with quotes
+std::string JsonString (const std::string& text);
+
+
+// json line of a scramble that is not solved because of error
+std::string UnsolvedJson (const ScrambleLine& scramble, const std::string& error);
+
+
+// solves the scramble and returns its json line (without newline)
+// {"line":1,"input":"R U","solved":true,"solution":"U' R'","depth":2,"nodes":2,"time_s":0.001,"optimal":true}
+// a line that could not be parsed or solved gets an "error" instead of the solution
+std::string SolveScramble (const PuppetCube& puppet_cube, SolveState& state, const SolveOptions& options, const ScrambleLine& scramble);
+
+
+// solves the lines of --input with concurrent_solves solvers and writes their json lines to --output in input order
+// reading, solving and writing overlap
+void StreamSolve (ErrorHandler error_handler, Setting& settings, Actions& actions, const PuppetCube& puppet_cube);
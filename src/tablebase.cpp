@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cstdint>
+#include <iterator>
+#include <utility>
 #include <string>
 #include <thread>
 #include <vector>
@@ -9,45 +15,149 @@
 #include "actions.h"
 #include "error_handler.h"
 #include "settings.h"
+#include "tablebase.h"
+#include "thread_pool.h"
+
+
+// the depth of a position is stored in the bits of its hash that are never set:
+// bit 27 above the corner hash and bits 61 to 63 above the edge hash
+constexpr uint64_t kDepthBits = (uint64_t(7) << 61) | (uint64_t(1) << 27); // NOLINT
+
+
+Cube::Hash TablebaseKey (Cube::Hash hash) {
+    return {hash.hash_1 & ~kDepthBits, hash.hash_2};
+}
+
+
+Cube::Hash WithDepth (Cube::Hash key, int depth) {
+    return {key.hash_1 | (uint64_t(depth >> 1) << 61) | (uint64_t(depth & 1) << 27), key.hash_2}; // NOLINT
+}
+
+
+int StoredDepth (Cube::Hash hash) {
+    return int((hash.hash_1 >> 61) << 1) | int((hash.hash_1 >> 27) & 1); // NOLINT
+}
 
 
 struct PositionHash {
-    // memory optimized representation of the cube
+    // memory optimized representation of the cube with its depth
     Cube::Hash hash;
 
+    // the depth is not part of the key
     bool operator==(const PositionHash& position) const {
-        return hash.hash_1 == position.hash.hash_1 && hash.hash_2 == position.hash.hash_2;
+        return (hash.hash_1 & ~kDepthBits) == (position.hash.hash_1 & ~kDepthBits) && hash.hash_2 == position.hash.hash_2;
     }
 
     friend size_t hash_value(const PositionHash& position) { // NOLINT
-        return phmap::HashState::combine(0, position.hash.hash_1, position.hash.hash_2);
+        return phmap::HashState::combine(0, position.hash.hash_1 & ~kDepthBits, position.hash.hash_2);
     }
 };
 
 
-// positions reached from the solved cube after a specific number of moves
+// all positions reached from the solved cube within the tablebase depth and their number of moves
+// one probe answers if a position is in the tablebase and at which depth
 using Tablebase = phmap::parallel_flat_hash_set<PositionHash,
         phmap::priv::hash_default_hash<PositionHash>,
         phmap::priv::hash_default_eq<PositionHash>,
         phmap::priv::Allocator<PositionHash>,
         12, std::mutex>;
-std::vector<Tablebase> tablebase;
+Tablebase tablebase;
+
+
+// the same positions in ascending order of their keys, used instead of tablebase by --tablebase_build=sort
+std::vector<Cube::Hash> sorted_tablebase;
+
+// the new positions are split by their highest key bits, bits above 60 of hash_1 are never part of the key
+constexpr int kSortBucketBits = 8;
+constexpr int kNumSortBuckets = 1 << kSortBucketBits;
+// positions of the tablebase scanned at once by a worker
+constexpr size_t kSortChunk = 4096;
+
+
+bool KeyLess (const Cube::Hash& a, const Cube::Hash& b) {
+    uint64_t key_a = a.hash_1 & ~kDepthBits;
+    uint64_t key_b = b.hash_1 & ~kDepthBits;
+    return key_a < key_b || (key_a == key_b && a.hash_2 < b.hash_2);
+}
+
+
+bool KeyEqual (const Cube::Hash& a, const Cube::Hash& b) {
+    return (a.hash_1 & ~kDepthBits) == (b.hash_1 & ~kDepthBits) && a.hash_2 == b.hash_2;
+}
+
+
+int SortBucket (const Cube::Hash& hash) {
+    return (hash.hash_1 & ~kDepthBits) >> (61 - kSortBucketBits); // NOLINT
+}
+
+
+// immutable open addressing table of the tablebase, its slots may be in shared memory
+struct FrozenTablebase {
+    const Cube::Hash* slots = nullptr;
+    uint64_t mask = 0;
+};
+FrozenTablebase frozen_tablebase;
+
+// no position has all bits set
+constexpr uint64_t kEmptyFrozenSlot = ~uint64_t(0);
+
+// deepest complete layer, -1 before the tablebase is built
+int built_tablebase_depth = -1;
+
+
+// home slot of a position, it is part of the format of the shared tables
+uint64_t FrozenHome (Cube::Hash key) {
+    uint64_t mixed = key.hash_1 ^ (uint64_t(key.hash_2) << 56); // NOLINT
+    mixed ^= mixed >> 33; // NOLINT
+    mixed *= 0xff51afd7ed558ccd; // NOLINT
+    mixed ^= mixed >> 33; // NOLINT
+    mixed *= 0xc4ceb9fe1a85ec53; // NOLINT
+    mixed ^= mixed >> 33; // NOLINT
+    return mixed;
+}
+
+
+int FrozenDepth (Cube::Hash key) {
+    for (uint64_t slot = FrozenHome(key) & frozen_tablebase.mask;; slot = (slot + 1) & frozen_tablebase.mask) {
+        const Cube::Hash& entry = frozen_tablebase.slots[slot];
+        if (entry.hash_1 == kEmptyFrozenSlot) {
+            return -1;
+        }
+        if (KeyEqual(entry, key)) {
+            // the shared tables may be deeper than this process uses
+            int depth = StoredDepth(entry);
+            return depth <= built_tablebase_depth ? depth : -1;
+        }
+    }
+}
+
+
+// depth of the position or -1 if it is not in the tablebase
+int TablebaseLookup (Cube::Hash hash) {
+    if (frozen_tablebase.slots != nullptr) {
+        return FrozenDepth(hash);
+    }
+    if (!sorted_tablebase.empty()) {
+        auto it = std::lower_bound(sorted_tablebase.begin(), sorted_tablebase.end(), hash, KeyLess);
+        return it != sorted_tablebase.end() && KeyEqual(*it, hash) ? StoredDepth(*it) : -1;
+    }
+    int depth = -1;
+    tablebase.if_contains({hash}, [&depth](const PositionHash& position) {
+        depth = StoredDepth(position.hash);
+    });
+    return depth;
+}
 
 
 // check if the cube is in the outermost tablebase;
 bool TablebaseContainsOuter (Cube::Hash hash) {
-    return tablebase.back().contains({hash});
+    return TablebaseLookup(hash) == built_tablebase_depth;
 }
 
 
 // check if the position is in the tablebase and return its depth
 int TablebaseDepth (Cube& cube) {
-    for (size_t i = 0; i < tablebase.size(); i++) {
-        if (tablebase[i].contains({cube.GetHash()})) {
-            return i;
-        }
-    }
-    return -1;
+    return TablebaseLookup(cube.GetHash());
 }
 
 
@@ -75,82 +185,229 @@ bool TablebaseSolve (Cube& cube, Actions& actions, int depth, uint64_t& num_posi
 }
 
 
-void ParallelTablebaseIncrease(int depth, int thread_id, int num_threads) {
-    // go over all positions of this depth
-    auto current_it = tablebase[depth].begin();
-    if (current_it == tablebase[depth].end()) {
-        return;
-    }
+// the workers take whole submaps of the tablebase from next_submap, so every position of the layer is expanded once
+void ParallelTablebaseIncrease(int depth, std::atomic<size_t>& next_submap, std::atomic<uint64_t>& num_new_positions) {
+    std::vector<Cube::Hash> positions;
+    for (size_t submap = next_submap++; submap < Tablebase::subcnt(); submap = next_submap++) {
+        // the layer of the submap is copied, its lock would block the inserts below
+        positions.clear();
+        tablebase.with_submap(submap, [depth, &positions](const auto& set) {
+            for (const PositionHash& position : set) {
+                if (StoredDepth(position.hash) == depth) {
+                    positions.push_back(TablebaseKey(position.hash));
+                }
+            }
+        });
+
+        for (Cube::Hash hash : positions) {
+            Cube cube = DecodeHash(hash);
+
+            // do all moves
+            std::vector<Rotations> legal_rotations = GetLegalRotations(cube);
+            for (Rotations rotation : legal_rotations) {
+                Cube next_cube = Rotate(cube, rotation);
+                PositionHash next_hash = {WithDepth(next_cube.GetHash(), depth+1)};
 
-    for (int i = 0; i < thread_id; i++) {
-        if (++current_it == tablebase[depth].end()) {
-            return;
+                // positions of all smaller depths are already in the tablebase
+                if (tablebase.lazy_emplace_l(next_hash, []([[maybe_unused]]Tablebase::value_type& value){}, [next_hash](const Tablebase::constructor& ctor){ctor(next_hash);})) {
+                    num_new_positions++;
+                }
+            }
         }
     }
+}
 
-    while (true) {
-        Cube cube = DecodeHash(current_it->hash);
-
-        // do all moves
-        std::vector<Rotations> legal_rotations = GetLegalRotations(cube);
-        for (Rotations rotation : legal_rotations) {
-            Cube next_cube = Rotate(cube, rotation);
-            PositionHash next_hash = {next_cube.GetHash()};
 
-            // check if the position is not already searched
-            if (tablebase[depth+1].contains(next_hash) || tablebase[depth].contains(next_hash) || (depth > 0 && tablebase[depth-1].contains(next_hash))) {
+// the neighbours of a part of layer depth are appended to the buckets of the worker
+void SortedTablebaseExpand (int depth, std::atomic<size_t>& next_chunk, std::vector<std::vector<Cube::Hash>>& buckets) {
+    for (size_t begin = next_chunk.fetch_add(kSortChunk); begin < sorted_tablebase.size(); begin = next_chunk.fetch_add(kSortChunk)) {
+        size_t end = std::min(begin + kSortChunk, sorted_tablebase.size());
+        for (size_t i = begin; i < end; i++) {
+            if (StoredDepth(sorted_tablebase[i]) != depth) {
                 continue;
             }
-
-            tablebase[depth+1].lazy_emplace_l(std::move(next_hash), []([[maybe_unused]]Tablebase::value_type& value){}, [next_hash](const Tablebase::constructor& ctor){ctor(std::move(next_hash));});
+            Cube cube = DecodeHash(TablebaseKey(sorted_tablebase[i]));
+            for (Rotations rotation : GetLegalRotations(cube)) {
+                Cube::Hash next_hash = Rotate(cube, rotation).GetHash();
+                buckets[SortBucket(next_hash)].push_back(next_hash);
+            }
         }
+    }
+}
 
-        for (int i = 0; i < num_threads; i++) {
-            if (++current_it == tablebase[depth].end()) {
-                return;
-            }
+
+// positions of the tablebase in the bucket
+std::pair<size_t, size_t> SortedBucketRange (int bucket) {
+    auto begin = std::partition_point(sorted_tablebase.begin(), sorted_tablebase.end(), [bucket](const Cube::Hash& hash) { return SortBucket(hash) < bucket; });
+    auto end = std::partition_point(begin, sorted_tablebase.end(), [bucket](const Cube::Hash& hash) { return SortBucket(hash) <= bucket; });
+    return {begin - sorted_tablebase.begin(), end - sorted_tablebase.begin()};
+}
+
+
+// sorts the new positions of one bucket and removes the duplicates and the positions of the tablebase
+std::vector<Cube::Hash> SortedTablebaseMerge (int depth, int bucket, std::pair<size_t, size_t> range, std::vector<std::vector<std::vector<Cube::Hash>>>& generated) {
+    std::vector<Cube::Hash> positions;
+    size_t num_positions = 0;
+    for (const auto& buckets : generated) {
+        num_positions += buckets[bucket].size();
+    }
+    positions.reserve(num_positions);
+    for (auto& buckets : generated) {
+        positions.insert(positions.end(), buckets[bucket].begin(), buckets[bucket].end());
+        buckets[bucket] = std::vector<Cube::Hash>();
+    }
+    std::sort(positions.begin(), positions.end(), KeyLess);
+    positions.erase(std::unique(positions.begin(), positions.end(), KeyEqual), positions.end());
+
+    // the tablebase is sorted, so one pass removes the positions found before
+    std::vector<Cube::Hash> new_positions;
+    new_positions.reserve(positions.size());
+    std::set_difference(positions.begin(), positions.end(), sorted_tablebase.begin() + range.first, sorted_tablebase.begin() + range.second, std::back_inserter(new_positions), KeyLess);
+    for (Cube::Hash& hash : new_positions) {
+        hash = WithDepth(hash, depth+1);
+    }
+    return new_positions;
+}
+
+
+// breadth first search without locks: the next layer is generated into buckets per worker
+// then every bucket is sorted, merged on its own and merged into its range of the tablebase
+uint64_t SortedTablebaseIncrease (Setting& settings, int depth) {
+    int num_workers = settings.num_threads;
+    std::vector<std::vector<std::vector<Cube::Hash>>> generated(num_workers, std::vector<std::vector<Cube::Hash>>(kNumSortBuckets));
+    std::atomic<size_t> next_chunk = 0;
+    GetThreadPool(settings).Run(num_workers, [depth, &next_chunk, &generated](int worker) {
+        SortedTablebaseExpand(depth, next_chunk, generated[worker]);
+    });
+
+    std::vector<std::pair<size_t, size_t>> ranges(kNumSortBuckets);
+    std::vector<std::vector<Cube::Hash>> merged(kNumSortBuckets);
+    std::atomic<int> next_bucket = 0;
+    GetThreadPool(settings).Run(num_workers, [depth, &next_bucket, &ranges, &generated, &merged]([[maybe_unused]]int worker) {
+        for (int bucket = next_bucket++; bucket < kNumSortBuckets; bucket = next_bucket++) {
+            ranges[bucket] = SortedBucketRange(bucket);
+            merged[bucket] = SortedTablebaseMerge(depth, bucket, ranges[bucket], generated);
         }
+    });
+
+    // the buckets are in ascending order, every bucket starts after the old and new positions of the buckets before
+    std::vector<size_t> offsets(kNumSortBuckets);
+    uint64_t num_new_positions = 0;
+    for (int bucket = 0; bucket < kNumSortBuckets; bucket++) {
+        offsets[bucket] = ranges[bucket].first + num_new_positions;
+        num_new_positions += merged[bucket].size();
     }
+    std::vector<Cube::Hash> next_tablebase(sorted_tablebase.size() + num_new_positions);
+    next_bucket = 0;
+    GetThreadPool(settings).Run(num_workers, [&next_bucket, &ranges, &merged, &offsets, &next_tablebase]([[maybe_unused]]int worker) {
+        for (int bucket = next_bucket++; bucket < kNumSortBuckets; bucket = next_bucket++) {
+            std::merge(sorted_tablebase.begin() + ranges[bucket].first, sorted_tablebase.begin() + ranges[bucket].second,
+                       merged[bucket].begin(), merged[bucket].end(), next_tablebase.begin() + offsets[bucket], KeyLess);
+            merged[bucket] = std::vector<Cube::Hash>();
+        }
+    });
+    sorted_tablebase = std::move(next_tablebase);
+    return num_new_positions;
 }
 
 
 // this function will use a BFS to find all positions of specific depth
 void TablebaseSearch (ErrorHandler error_handler, Setting& settings, int depth) {
-    if (int(tablebase.size()-1) >= depth) {
+    if (depth > kMaxTablebaseDepth) {
+        error_handler.Handle(ErrorHandler::Level::kWarning, "tablebase.cpp", "the tablebase depth is limited to " + std::to_string(kMaxTablebaseDepth));
+        depth = kMaxTablebaseDepth;
+    }
+    // the frozen tablebase cannot grow
+    if (built_tablebase_depth >= depth || frozen_tablebase.slots != nullptr) {
         return;
     }
 
     // get duration time
     auto start_time = std::chrono::system_clock::now();
-    error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", "resize tablebase from depth " + std::to_string((tablebase.empty() ? 0 : tablebase.size()-1)) + " to " + std::to_string(depth));
+    error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", "resize tablebase from depth " + std::to_string(std::max(built_tablebase_depth, 0)) + " to " + std::to_string(depth));
+
+    // a tablebase keeps the layout it was started with
+    bool sorted = !sorted_tablebase.empty() || (built_tablebase_depth == -1 && settings.tablebase_build == Setting::TablebaseBuild::kSort);
 
     // solved position
-    if (tablebase.empty()) {
-        tablebase.push_back(Tablebase());
-        tablebase[0].insert({0, 0});
+    if (built_tablebase_depth == -1) {
+        if (sorted) {
+            sorted_tablebase.push_back({0, 0});
+        }
+        else {
+            tablebase.insert({{0, 0}});
+        }
+        built_tablebase_depth = 0;
     }
 
     // search from the next depth
-    for (int i = tablebase.size()-1; i < depth; i++) {
-        tablebase.push_back(Tablebase());
-        // start multiple threads
-        {
-            std::vector<std::jthread> threads;
-            for (int j = 0; j < settings.num_threads; j++) {
-                threads.push_back(std::jthread(ParallelTablebaseIncrease, i, j, settings.num_threads));
-            }
+    for (int i = built_tablebase_depth; i < depth; i++) {
+        uint64_t num_new_positions = 0;
+        if (sorted) {
+            num_new_positions = SortedTablebaseIncrease(settings, i);
+        }
+        else {
+            // every worker of the thread pool expands the submaps it takes
+            std::atomic<size_t> next_submap = 0;
+            std::atomic<uint64_t> num_inserted = 0;
+            GetThreadPool(settings).Run(settings.num_threads, [i, &next_submap, &num_inserted]([[maybe_unused]]int worker) {
+                ParallelTablebaseIncrease(i, next_submap, num_inserted);
+            });
+            num_new_positions = num_inserted;
         }
-        error_handler.Handle(ErrorHandler::Level::kExtra, "tablebase.cpp", "tablebase size depth " + std::to_string(i+1) + ": " + std::to_string(tablebase.back().size()));
+        built_tablebase_depth = i+1;
+        error_handler.Handle(ErrorHandler::Level::kExtra, "tablebase.cpp", "tablebase size depth " + std::to_string(i+1) + ": " + std::to_string(num_new_positions));
     }
 
     // get duration time
     auto end_time = std::chrono::system_clock::now();
     std::chrono::duration<double> time_duration = end_time - start_time;
 
-    error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", "set tablebase size to: " + std::to_string(tablebase.size()-1) + " in " + std::to_string(time_duration.count()) + " seconds");
+    error_handler.Handle(ErrorHandler::Level::kInfo, "search.cpp", "set tablebase size to: " + std::to_string(built_tablebase_depth) + " in " + std::to_string(time_duration.count()) + " seconds");
 }
 
 
 int GetTablebaseDepth () {
-    return tablebase.size()-1;
+    return built_tablebase_depth;
+}
+
+
+// at most 3/4 of the slots are used
+uint64_t FrozenTablebaseSlots () {
+    size_t size = sorted_tablebase.empty() ? tablebase.size() : sorted_tablebase.size();
+    return std::bit_ceil(size * 4 / 3 + 1);
+}
+
+
+void FreezePosition (Cube::Hash* slots, uint64_t mask, Cube::Hash hash) {
+    uint64_t slot = FrozenHome(TablebaseKey(hash)) & mask;
+    while (slots[slot].hash_1 != kEmptyFrozenSlot) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = hash;
+}
+
+
+void FreezeTablebase (Cube::Hash* slots) {
+    uint64_t mask = FrozenTablebaseSlots() - 1;
+    for (uint64_t slot = 0; slot <= mask; slot++) {
+        slots[slot] = {kEmptyFrozenSlot, uint8_t(kEmptyFrozenSlot)};
+    }
+    if (!sorted_tablebase.empty()) {
+        for (Cube::Hash hash : sorted_tablebase) {
+            FreezePosition(slots, mask, hash);
+        }
+        return;
+    }
+    for (const PositionHash& position : tablebase) {
+        FreezePosition(slots, mask, position.hash);
+    }
+}
+
+
+void UseFrozenTablebase (const Cube::Hash* slots, uint64_t num_slots, int depth) {
+    frozen_tablebase = {slots, num_slots - 1};
+    built_tablebase_depth = depth;
+    tablebase = Tablebase();
+    sorted_tablebase = std::vector<Cube::Hash>();
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+
+
 #include "actions.h"
 #include "cube.h"
 #include "error_handler.h"
@@ -19,3 +22,18 @@ void TablebaseSearch (ErrorHandler error_handler, Setting& settings, int depth);
 
 
 int GetTablebaseDepth ();
+
+
+// the depth of a position is stored beside its key in 4 bits
+constexpr int kMaxTablebaseDepth = 15;
+
+
+// the frozen tablebase is an immutable open addressing table of Cube::Hash slots without pointers
+// so it can be shared between processes, empty slots have all bits set
+uint64_t FrozenTablebaseSlots ();
+
+// writes the positions of the tablebase with their depth into its FrozenTablebaseSlots() slots
+void FreezeTablebase (Cube::Hash* slots);
+
+// the frozen tablebase is probed up to depth from now on, the built tablebase is freed
+void UseFrozenTablebase (const Cube::Hash* slots, uint64_t num_slots, int depth);
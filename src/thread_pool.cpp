@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+#include "settings.h"
+#include "thread_pool.h"
+
+
+// keeps the caches of a worker warm between tasks
+void PinThread (int cpu) {
+    #ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    #endif
+}
+
+
+ThreadPool::ThreadPool (int num_workers, bool pin_workers) {
+    int num_cpus = std::max(int(std::thread::hardware_concurrency()), 1);
+    for (int i = 0; i < num_workers; i++) {
+        workers_.push_back(std::jthread([this, i, pin_workers, num_cpus]() {
+            if (pin_workers) {
+                PinThread(i % num_cpus);
+            }
+            Work();
+        }));
+    }
+}
+
+
+ThreadPool::~ThreadPool () {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    work_.notify_all();
+}
+
+
+void ThreadPool::Run (int num_tasks, const std::function<void (int)>& task) {
+    int remaining = num_tasks;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (int i = 0; i < num_tasks; i++) {
+            tasks_.push_back([this, &task, &remaining, i]() {
+                task(i);
+                std::lock_guard<std::mutex> guard(mutex_);
+                if (--remaining == 0) {
+                    done_.notify_all();
+                }
+            });
+        }
+    }
+    work_.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&remaining]() {return remaining == 0;});
+}
+
+
+void ThreadPool::Work () {
+    while (true) {
+        std::function<void ()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_.wait(lock, [this]() {return stop_ || !tasks_.empty();});
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+
+ThreadPool& GetThreadPool (const Setting& settings) {
+    static ThreadPool thread_pool(settings.num_threads, settings.pin_threads);
+    return thread_pool;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+#include "settings.h"
+
+
+// workers living as long as the process, shared by the searches and the tablebase
+// so every solve does not have to start and join its own threads
+class ThreadPool {
+public:
+    // workers can be pinned to one cpu each
+    ThreadPool (int num_workers, bool pin_workers);
+    ~ThreadPool ();
+
+    // runs task(0) to task(num_tasks - 1) on the workers and waits until all of them returned
+    // tasks beyond the number of workers start once a worker is free
+    void Run (int num_tasks, const std::function<void (int)>& task);
+
+    int NumWorkers () const {
+        return workers_.size();
+    }
+
+private:
+    void Work ();
+
+    std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable done_;
+    std::deque<std::function<void ()>> tasks_;
+    bool stop_ = false;
+    std::vector<std::jthread> workers_;
+};
+
+
+// pool of the process, created with --threads and --pin_threads on the first call
+ThreadPool& GetThreadPool (const Setting& settings);
+
+
+// memory of the calling worker that survives between its tasks
+template <class T>
+T& WorkerScratch () {
+    thread_local T scratch;
+    return scratch;
+}
@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+
+#include "cube.h"
+#include "rotation.h"
+#include "settings.h"
+#include "thread_pool.h"
+#include "visited.h"
+
+
+// mix the remainder to spread positions over the table
+uint64_t MixRemainder (uint64_t remainder) {
+    remainder ^= remainder >> 33; // NOLINT
+    remainder *= 0xff51afd7ed558ccd; // NOLINT
+    remainder ^= remainder >> 33; // NOLINT
+    remainder *= 0xc4ceb9fe1a85ec53; // NOLINT
+    remainder ^= remainder >> 33; // NOLINT
+    return remainder;
+}
+
+
+VisitedTable::VisitedTable (int slot_bits, Setting::Replacement replacement) :
+        home_bits_(replacement == Setting::Replacement::kExact ? slot_bits : slot_bits - kBucketBits),
+        mask_((uint64_t(1) << slot_bits) - 1),
+        replacement_(replacement),
+        slots_(std::make_unique<std::atomic<uint64_t>[]>(mask_ + 1)) {
+}
+
+
+void VisitedTable::Split (Cube::Hash hash, uint64_t& home, uint64_t& remainder) const {
+    // 27 bit corner hash and 41 bit edge hash (see Cube::GetHash)
+    uint64_t corner_hash = (hash.hash_1 << 36) >> 36; // NOLINT
+    uint64_t edge_hash = ((hash.hash_1 >> 28) << 8) | uint64_t(hash.hash_2); // NOLINT
+    const int corner_bits = 27;
+
+    // the lowest home_bits_ bits of the position select the slot or bucket
+    uint64_t home_mask = (uint64_t(1) << home_bits_) - 1;
+    uint64_t low;
+    if (home_bits_ <= corner_bits) {
+        low = corner_hash & home_mask;
+        remainder = (corner_hash >> home_bits_) | (edge_hash << (corner_bits - home_bits_));
+    }
+    else {
+        low = (corner_hash | (edge_hash << corner_bits)) & home_mask;
+        remainder = edge_hash >> (home_bits_ - corner_bits);
+    }
+
+    // the remainder together with the home slot still identifies the position
+    home = (low ^ MixRemainder(remainder)) & home_mask;
+}
+
+
+Cube::Hash VisitedTable::Join (uint64_t home, uint64_t remainder) const {
+    const int corner_bits = 27;
+    uint64_t home_mask = (uint64_t(1) << home_bits_) - 1;
+    uint64_t low = (home ^ MixRemainder(remainder)) & home_mask;
+
+    uint64_t corner_hash;
+    uint64_t edge_hash;
+    if (home_bits_ <= corner_bits) {
+        corner_hash = ((remainder << home_bits_) | low) & ((uint64_t(1) << corner_bits) - 1);
+        edge_hash = remainder >> (corner_bits - home_bits_);
+    }
+    else {
+        corner_hash = low & ((uint64_t(1) << corner_bits) - 1);
+        edge_hash = (low >> corner_bits) | (remainder << (home_bits_ - corner_bits));
+    }
+    return {corner_hash | ((edge_hash >> 8) << 28), uint8_t(edge_hash)}; // NOLINT
+}
+
+
+bool VisitedTable::Find (Cube::Hash hash, uint8_t& depth, Rotations& rotation) const {
+    uint64_t home;
+    uint64_t remainder;
+    Split(hash, home, remainder);
+
+    bool lossy = Lossy();
+    uint64_t first_slot = lossy ? home << kBucketBits : home;
+    uint64_t num_slots = lossy ? kBucketSize : kMaxDisplacement + 1;
+    for (uint64_t displacement = 0; displacement < num_slots; displacement++) {
+        uint64_t slot = slots_[(first_slot + displacement) & mask_].load(std::memory_order_acquire);
+        // removed positions become tombstones, so an empty slot still ends the probe sequence
+        if (slot == 0 && !lossy) {
+            return false;
+        }
+        if (slot != 0 && slot != kTombstone && (lossy || (slot & kMaxDisplacement) == displacement) && slot >> kRemainderOffset == remainder) {
+            depth = SlotDepth(slot);
+            rotation = SlotRotation(slot);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool VisitedTable::Update (Cube::Hash hash, uint8_t depth, Rotations rotation) {
+    uint64_t home;
+    uint64_t remainder;
+    Split(hash, home, remainder);
+
+    uint64_t stored_rotation = rotation == Rotations(-1) ? (1 << kRotationBits) - 1 : uint64_t(rotation);
+    uint64_t value = (uint64_t(depth + 1) << kDepthOffset) | (stored_rotation << kRotationOffset);
+
+    if (Lossy()) {
+        return UpdateBucket(home, remainder, value, depth);
+    }
+
+    while (true) {
+        // first tombstone of the probe sequence
+        uint64_t tombstone = kMaxDisplacement + 1;
+        bool reuse = false;
+        for (uint64_t displacement = 0; displacement <= kMaxDisplacement && !reuse; displacement++) {
+            std::atomic<uint64_t>& slot = slots_[(home + displacement) & mask_];
+            uint64_t new_slot = (remainder << kRemainderOffset) | value | displacement;
+            uint64_t current = slot.load(std::memory_order_acquire);
+            while (true) {
+                if (current == kTombstone) {
+                    tombstone = std::min(tombstone, displacement);
+                    break;
+                }
+                // empty slot, the position is not stored behind it
+                if (current == 0) {
+                    if (tombstone <= kMaxDisplacement) {
+                        reuse = true;
+                        break;
+                    }
+                    if (slot.compare_exchange_weak(current, new_slot)) {
+                        RemoveDuplicates(home, remainder);
+                        return true;
+                    }
+                    continue;
+                }
+                // another position
+                if ((current & kMaxDisplacement) != displacement || current >> kRemainderOffset != remainder) {
+                    break;
+                }
+                // atomic min of the depth
+                if (SlotDepth(current) <= depth) {
+                    return false;
+                }
+                if (slot.compare_exchange_weak(current, new_slot, std::memory_order_acq_rel)) {
+                    return true;
+                }
+            }
+        }
+        if (tombstone > kMaxDisplacement) {
+            overflowed_ = true;
+            return false;
+        }
+
+        uint64_t expected = kTombstone;
+        if (slots_[(home + tombstone) & mask_].compare_exchange_strong(expected, (remainder << kRemainderOffset) | value | tombstone)) {
+            RemoveDuplicates(home, remainder);
+            return true;
+        }
+        // another thread used the tombstone, maybe for this position
+    }
+}
+
+
+void VisitedTable::RemoveDuplicates (uint64_t home, uint64_t remainder) {
+    // a thread that probed past a slot before it became a tombstone stores the position behind it
+    // both threads look for the other copy after storing theirs, sequentially consistent so one of them finds it
+    uint64_t first = kMaxDisplacement + 1;
+    for (uint64_t displacement = 0; displacement <= kMaxDisplacement; displacement++) {
+        std::atomic<uint64_t>& slot = slots_[(home + displacement) & mask_];
+        uint64_t current = slot.load();
+        if (current == 0) {
+            return;
+        }
+        if (current == kTombstone || (current & kMaxDisplacement) != displacement || current >> kRemainderOffset != remainder) {
+            continue;
+        }
+        if (first > kMaxDisplacement) {
+            first = displacement;
+            continue;
+        }
+
+        // the later copy becomes a tombstone
+        while (current != kTombstone && !slot.compare_exchange_weak(current, kTombstone)) {}
+        if (current == kTombstone) {
+            continue;
+        }
+        // atomic min of the depth of the first copy, it takes the rotation along
+        std::atomic<uint64_t>& first_slot = slots_[(home + first) & mask_];
+        uint64_t kept = first_slot.load();
+        uint64_t merged = (current & ~kMaxDisplacement) | first;
+        while ((kept & kMaxDisplacement) == first && kept >> kRemainderOffset == remainder && SlotDepth(kept) > SlotDepth(merged)) {
+            if (first_slot.compare_exchange_weak(kept, merged)) {
+                break;
+            }
+        }
+    }
+}
+
+
+bool VisitedTable::UpdateBucket (uint64_t bucket, uint64_t remainder, uint64_t value, uint8_t depth) {
+    std::atomic<uint64_t>* slots = &slots_[bucket << kBucketBits];
+    uint64_t age = generation_.load(std::memory_order_relaxed) & kMaxDisplacement;
+    uint64_t new_slot = (remainder << kRemainderOffset) | value | age;
+
+    while (true) {
+        // look for the position or an empty slot
+        int empty = -1;
+        std::array<uint64_t, kBucketSize> current;
+        for (int i = 0; i < kBucketSize; i++) {
+            current[i] = slots[i].load(std::memory_order_acquire);
+            if (current[i] == 0) {
+                if (empty == -1) {
+                    empty = i;
+                }
+                continue;
+            }
+            if (current[i] >> kRemainderOffset != remainder) {
+                continue;
+            }
+            // atomic min of the depth
+            while (current[i] >> kRemainderOffset == remainder && SlotDepth(current[i]) > depth) {
+                if (slots[i].compare_exchange_weak(current[i], new_slot, std::memory_order_acq_rel)) {
+                    return true;
+                }
+            }
+            // true if it got replaced by another position in the meantime
+            return current[i] >> kRemainderOffset != remainder;
+        }
+
+        int victim = empty;
+        if (victim == -1) {
+            victim = 0;
+            for (int i = 1; i < kBucketSize; i++) {
+                bool replace = SlotDepth(current[i]) > SlotDepth(current[victim]);
+                uint64_t slot_age = (age - current[i]) & kMaxDisplacement;
+                uint64_t victim_age = (age - current[victim]) & kMaxDisplacement;
+                if (replacement_ == Setting::Replacement::kAge && slot_age != victim_age) {
+                    replace = slot_age > victim_age;
+                }
+                if (replace) {
+                    victim = i;
+                }
+            }
+            // depth preferred keeps the shallower positions, the new one is searched without entry
+            if (replacement_ == Setting::Replacement::kDepth && SlotDepth(current[victim]) < depth) {
+                return true;
+            }
+        }
+
+        if (slots[victim].compare_exchange_strong(current[victim], new_slot, std::memory_order_acq_rel)) {
+            return true;
+        }
+        // the bucket changed, look at it again
+    }
+}
+
+
+size_t VisitedTable::Sweep (uint64_t first, uint64_t last, const std::function<bool (Cube::Hash, uint8_t)>& remove) {
+    bool lossy = Lossy();
+    size_t num_removed = 0;
+    for (uint64_t i = first; i < last; i++) {
+        uint64_t slot = slots_[i].load(std::memory_order_acquire);
+        if (slot == 0 || slot == kTombstone) {
+            continue;
+        }
+        uint64_t home = lossy ? i >> kBucketBits : (i - (slot & kMaxDisplacement)) & mask_;
+        if (!remove(Join(home, slot >> kRemainderOffset), SlotDepth(slot))) {
+            continue;
+        }
+        // buckets have no probe sequences to keep intact
+        // the entry may have changed in the meantime, it is kept then
+        num_removed += size_t(slots_[i].compare_exchange_strong(slot, lossy ? 0 : kTombstone, std::memory_order_acq_rel));
+    }
+    return num_removed;
+}
+
+
+void VisitedTable::Clear (ThreadPool& pool) {
+    // 32 MB per chunk
+    const uint64_t chunk_size = uint64_t(1) << 22;
+    uint64_t num_slots = mask_ + 1;
+    int num_chunks = (num_slots + chunk_size - 1) / chunk_size;
+    pool.Run(num_chunks, [this, chunk_size, num_slots](int chunk) {
+        for (uint64_t i = chunk * chunk_size; i < std::min((chunk + 1) * chunk_size, num_slots); i++) {
+            slots_[i].store(0, std::memory_order_relaxed);
+        }
+    });
+    overflowed_ = false;
+    generation_ = 0;
+}
+
+
+void VisitedTable::ForEach (uint64_t first, uint64_t last, const std::function<void (Cube::Hash, uint8_t, Rotations)>& visit) const {
+    bool lossy = Lossy();
+    for (uint64_t i = first; i < last; i++) {
+        uint64_t slot = slots_[i].load(std::memory_order_acquire);
+        if (slot == 0 || slot == kTombstone) {
+            continue;
+        }
+        uint64_t home = lossy ? i >> kBucketBits : (i - (slot & kMaxDisplacement)) & mask_;
+        visit(Join(home, slot >> kRemainderOffset), SlotDepth(slot), SlotRotation(slot));
+    }
+}
+
+
+size_t VisitedTable::Size () const {
+    size_t size = 0;
+    for (uint64_t i = 0; i <= mask_; i++) {
+        uint64_t slot = slots_[i].load(std::memory_order_relaxed);
+        size += size_t(slot != 0 && slot != kTombstone);
+    }
+    return size;
+}
+
+
+Visited::Visited (const Setting& settings) {
+    if (settings.visited_memory == 0) {
+        if (settings.visited_rotations) {
+            map_ = std::make_unique<VisitedMap>();
+        }
+        else {
+            depth_map_ = std::make_unique<VisitedDepthMap>();
+        }
+        return;
+    }
+    // 2^20 / 8 slots per MB
+    const int slots_per_mb_bits = 17;
+    int slot_bits = std::bit_width(uint64_t(settings.visited_memory)) - 1 + slots_per_mb_bits;
+    int min_slot_bits = VisitedTable::kMinHomeBits + (settings.visited_replacement == Setting::Replacement::kExact ? 0 : VisitedTable::kBucketBits);
+    table_ = std::make_unique<VisitedTable>(std::max(slot_bits, min_slot_bits), settings.visited_replacement);
+}
+
+
+int Visited::Depth (Cube::Hash hash) const {
+    if (table_) {
+        uint8_t depth;
+        Rotations rotation;
+        return table_->Find(hash, depth, rotation) ? depth : kNotVisited;
+    }
+    int depth = kNotVisited;
+    if (depth_map_) {
+        depth_map_->if_contains({hash}, [&depth](const VisitedDepthMap::value_type& value) {depth = value.second;});
+        return depth;
+    }
+    map_->if_contains({hash}, [&depth](const VisitedMap::value_type& value) {depth = value.second.first;});
+    return depth;
+}
+
+
+bool Visited::Find (Cube::Hash hash, uint8_t& depth, Rotations& rotation) const {
+    if (table_) {
+        return table_->Find(hash, depth, rotation);
+    }
+    if (depth_map_) {
+        return depth_map_->if_contains({hash}, [&depth](const VisitedDepthMap::value_type& value) {depth = value.second;});
+    }
+    return map_->if_contains({hash}, [&depth, &rotation](const VisitedMap::value_type& value) {
+                                         depth = value.second.first;
+                                         rotation = value.second.second;
+                                     });
+}
+
+
+bool Visited::Update (Cube::Hash hash, uint8_t depth, Rotations rotation) {
+    if (table_) {
+        return table_->Update(hash, depth, rotation);
+    }
+    bool improved = true;
+    if (depth_map_) {
+        depth_map_->try_emplace_l({hash},
+                                  [&improved, depth](VisitedDepthMap::value_type& value) {
+                                      improved = depth < value.second;
+                                      if (improved) {
+                                          value.second = depth;
+                                      }
+                                  }, depth);
+        return improved;
+    }
+    map_->try_emplace_l({hash},
+                        [&improved, depth, rotation](VisitedMap::value_type& value) {
+                            improved = depth < value.second.first;
+                            if (improved) {
+                                value.second = {depth, rotation};
+                            }
+                        }, std::make_pair(depth, rotation));
+    return improved;
+}
+
+
+// erasing every entry keeps the array of the submap, clear would free it
+template <class Map>
+void EraseAll (Map& map) {
+    for (size_t i = 0; i < Map::subcnt(); i++) {
+        map.with_submap_m(i, [](auto& submap) {
+            for (auto it = submap.begin(); it != submap.end();) {
+                submap.erase(it++);
+            }
+        });
+    }
+}
+
+
+void Visited::Reset (ThreadPool& pool) {
+    if (table_) {
+        table_->Clear(pool);
+    }
+    else if (depth_map_) {
+        EraseAll(*depth_map_);
+    }
+    else {
+        EraseAll(*map_);
+    }
+}
+
+
+void Visited::NextGeneration () {
+    if (table_) {
+        table_->NextGeneration();
+    }
+}
+
+
+uint8_t EntryDepth (const std::pair<uint8_t, Rotations>& value) {
+    return value.first;
+}
+
+
+uint8_t EntryDepth (uint8_t value) {
+    return value;
+}
+
+
+template <class Map>
+size_t SweepSubmap (Map& map, size_t chunk, const std::function<bool (Cube::Hash, uint8_t)>& remove) {
+    size_t num_removed = 0;
+    map.with_submap_m(chunk, [&remove, &num_removed](auto& submap) {
+        for (auto it = submap.begin(); it != submap.end();) {
+            if (remove(it->first.hash, EntryDepth(it->second))) {
+                submap.erase(it++);
+                num_removed++;
+            }
+            else {
+                ++it;
+            }
+        }
+        // flat hash maps do not shrink by themselves
+        if (num_removed != 0) {
+            submap.rehash(0);
+        }
+    });
+    return num_removed;
+}
+
+
+size_t Visited::NumChunks () const {
+    return table_ ? (table_->Capacity() + kChunkSlots - 1) / kChunkSlots : VisitedMap::subcnt();
+}
+
+
+size_t Visited::SweepChunk (size_t chunk, const std::function<bool (Cube::Hash, uint8_t)>& remove) {
+    if (table_) {
+        return table_->Sweep(chunk * kChunkSlots, std::min((chunk + 1) * kChunkSlots, table_->Capacity()), remove);
+    }
+    if (depth_map_) {
+        return SweepSubmap(*depth_map_, chunk, remove);
+    }
+    return SweepSubmap(*map_, chunk, remove);
+}
+
+
+void Visited::ForEachInChunk (size_t chunk, const std::function<void (Cube::Hash, uint8_t, Rotations)>& visit) const {
+    if (table_) {
+        table_->ForEach(chunk * kChunkSlots, std::min((chunk + 1) * kChunkSlots, table_->Capacity()), visit);
+    }
+    else if (depth_map_) {
+        depth_map_->with_submap(chunk, [&visit](const auto& submap) {
+            for (const VisitedDepthMap::value_type& value : submap) {
+                visit(value.first.hash, value.second, Rotations(-1));
+            }
+        });
+    }
+    else {
+        map_->with_submap(chunk, [&visit](const auto& submap) {
+            for (const VisitedMap::value_type& value : submap) {
+                visit(value.first.hash, value.second.first, value.second.second);
+            }
+        });
+    }
+}
+
+
+size_t Visited::Size () const {
+    if (table_) {
+        return table_->Size();
+    }
+    return depth_map_ ? depth_map_->size() : map_->size();
+}
+
+
+size_t Visited::Capacity () const {
+    if (table_) {
+        return table_->Capacity();
+    }
+    return depth_map_ ? depth_map_->capacity() : map_->capacity();
+}
+
+
+size_t Visited::EntryBytes () const {
+    if (table_) {
+        return sizeof(uint64_t);
+    }
+    return depth_map_ ? sizeof(VisitedDepthMap::value_type) : sizeof(VisitedMap::value_type);
+}
+
+
+bool Visited::Lossy () const {
+    return table_ && table_->Lossy();
+}
+
+
+bool Visited::Overflowed () const {
+    return table_ && table_->Overflowed();
+}
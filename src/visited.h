@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <parallel_hashmap/phmap.h>
+
+
+#include "cube.h"
+#include "rotation.h"
+#include "settings.h"
+
+
+class ThreadPool;
+
+
+#pragma pack(push, 1)
+struct CubeMapVisited {
+    // memory optimized representation of the cube
+    Cube::Hash hash;
+
+    bool operator==(const CubeMapVisited& position) const {
+        return hash.hash_1 == position.hash.hash_1 && hash.hash_2 == position.hash.hash_2;
+    }
+
+    friend size_t hash_value(const CubeMapVisited& position) { // NOLINT
+        return phmap::HashState::combine(0, position.hash.hash_1, position.hash.hash_2);
+    }
+};
+#pragma pack(pop)
+
+
+using VisitedMap = phmap::parallel_flat_hash_map<CubeMapVisited, std::pair<uint8_t, Rotations>,
+            phmap::priv::hash_default_hash<CubeMapVisited>, phmap::priv::hash_default_eq<CubeMapVisited>,
+            phmap::priv::Allocator<std::pair<CubeMapVisited, std::pair<uint8_t, Rotations>>>,
+            12, std::mutex>;
+
+// only the depth, the path is found again with the depth labels
+using VisitedDepthMap = phmap::parallel_flat_hash_map<CubeMapVisited, uint8_t,
+            phmap::priv::hash_default_hash<CubeMapVisited>, phmap::priv::hash_default_eq<CubeMapVisited>,
+            phmap::priv::Allocator<std::pair<CubeMapVisited, uint8_t>>,
+            12, std::mutex>;
+
+
+// open addressing table of fixed size
+// every slot is one 64 bit word updated with compare and swap:
+// bit  0 -  5 distance from the home slot (exact) or age of the entry (lossy)
+// bit  6 - 10 rotation leading to the position
+// bit 11 - 17 depth + 1 (0 marks an empty slot)
+// bit 18 - 63 part of the 68 bit position not given by the home slot or bucket
+//
+// with a replacement policy every position may only use the kBucketSize slots of its bucket
+// and a full bucket replaces one of its entries
+//
+// removed entries of the exact table leave a tombstone, so positions behind it can still be found
+// an insert reuses the first tombstone of the probe sequence
+class VisitedTable {
+public:
+    // number of slots is 2^slot_bits
+    VisitedTable (int slot_bits, Setting::Replacement replacement);
+
+    // returns false if the position is not in the table
+    bool Find (Cube::Hash hash, uint8_t& depth, Rotations& rotation) const;
+
+    // inserts the position or lowers its depth
+    // returns true if the position was inserted or improved
+    // a lossy table also returns true if the position could not be stored
+    bool Update (Cube::Hash hash, uint8_t depth, Rotations rotation);
+
+    // removes all entries, the slots stay allocated
+    // the workers of the pool clear one chunk each
+    void Clear (ThreadPool& pool);
+
+    // entries written from now on are younger than all previous ones
+    void NextGeneration () {
+        ++generation_;
+    }
+
+    // removes the entries of the slots first to last - 1 selected by remove
+    // returns the number of removed entries
+    size_t Sweep (uint64_t first, uint64_t last, const std::function<bool (Cube::Hash, uint8_t)>& remove);
+
+    // calls visit for the entries of the slots first to last - 1
+    void ForEach (uint64_t first, uint64_t last, const std::function<void (Cube::Hash, uint8_t, Rotations)>& visit) const;
+
+    size_t Size () const;
+    size_t Capacity () const {
+        return mask_ + 1;
+    }
+
+    bool Lossy () const {
+        return replacement_ != Setting::Replacement::kExact;
+    }
+
+    // a position could not be inserted because all slots within kMaxDisplacement were used
+    bool Overflowed () const {
+        return overflowed_;
+    }
+
+    // the remainder has to fit into 46 bits
+    static constexpr int kMinHomeBits = 22;
+    static constexpr int kBucketBits = 2;
+    static constexpr int kBucketSize = 1 << kBucketBits;
+    static constexpr int kKeyBits = 68;
+
+private:
+    static constexpr int kDisplacementBits = 6;
+    static constexpr int kRotationBits = 5;
+    static constexpr int kDepthBits = 7;
+    static constexpr int kRotationOffset = kDisplacementBits;
+    static constexpr int kDepthOffset = kRotationOffset + kRotationBits;
+    static constexpr int kRemainderOffset = kDepthOffset + kDepthBits;
+    static constexpr uint64_t kMaxDisplacement = (uint64_t(1) << kDisplacementBits) - 1;
+    // depth bits 0 but not empty
+    static constexpr uint64_t kTombstone = kMaxDisplacement;
+
+    static uint8_t SlotDepth (uint64_t slot) {
+        return ((slot >> kDepthOffset) & ((1 << kDepthBits) - 1)) - 1;
+    }
+
+    static Rotations SlotRotation (uint64_t slot) {
+        uint8_t stored_rotation = (slot >> kRotationOffset) & ((1 << kRotationBits) - 1);
+        return stored_rotation == (1 << kRotationBits) - 1 ? Rotations(-1) : Rotations(stored_rotation);
+    }
+
+    // split the position into home slot (or bucket) and remainder
+    void Split (Cube::Hash hash, uint64_t& home, uint64_t& remainder) const;
+
+    // position of the home slot or bucket and the remainder
+    Cube::Hash Join (uint64_t home, uint64_t remainder) const;
+
+    bool UpdateBucket (uint64_t bucket, uint64_t remainder, uint64_t value, uint8_t depth);
+
+    // keeps only the copy of the position with the smallest displacement, with the smaller depth of both
+    void RemoveDuplicates (uint64_t home, uint64_t remainder);
+
+    // number of bits selecting the home slot or bucket
+    int home_bits_;
+    uint64_t mask_;
+    Setting::Replacement replacement_;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+    std::atomic<bool> overflowed_ = false;
+    std::atomic<uint64_t> generation_ = 0;
+};
+
+
+// all positions visited by the search with the lowest depth they have been reached
+// and the rotation leading to them (unless the growing map only stores depths)
+class Visited {
+public:
+    Visited (const Setting& settings);
+
+    static constexpr int kNotVisited = std::numeric_limits<int>::max();
+
+    // depth of the position or kNotVisited
+    int Depth (Cube::Hash hash) const;
+
+    // returns false if the position is not stored
+    // the rotation is only set if rotations are stored
+    bool Find (Cube::Hash hash, uint8_t& depth, Rotations& rotation) const;
+
+    // inserts the position or lowers its depth
+    // returns true if the position was inserted or improved
+    bool Update (Cube::Hash hash, uint8_t depth, Rotations rotation);
+
+    // removes all positions for the next search and keeps the memory of the table or map
+    void Reset (ThreadPool& pool);
+
+    // ages the entries of a table with replacement policy
+    void NextGeneration ();
+
+    // the entries are swept in chunks, every chunk blocks only a small part of the positions
+    size_t NumChunks () const;
+
+    // removes the entries of the chunk selected by remove and frees their memory if possible
+    // returns the number of removed entries
+    size_t SweepChunk (size_t chunk, const std::function<bool (Cube::Hash, uint8_t)>& remove);
+
+    // calls visit for the entries of the chunk, the rotation is Rotations(-1) if rotations are not stored
+    void ForEachInChunk (size_t chunk, const std::function<void (Cube::Hash, uint8_t, Rotations)>& visit) const;
+
+    size_t Size () const;
+    size_t Capacity () const;
+    size_t EntryBytes () const;
+
+    // the rotation leading to a position is stored
+    // otherwise the path has to be found with the depth labels
+    bool StoresRotations () const {
+        return !depth_map_;
+    }
+
+    // entries can be replaced, so the path to a position may be incomplete
+    bool Lossy () const;
+
+    // some positions could not be stored
+    bool Overflowed () const;
+
+private:
+    // slots of a fixed size table per chunk
+    static constexpr uint64_t kChunkSlots = uint64_t(1) << 16;
+
+    // growing hash map if no fixed size table is used
+    std::unique_ptr<VisitedMap> map_;
+    std::unique_ptr<VisitedDepthMap> depth_map_;
+    std::unique_ptr<VisitedTable> table_;
+};